@@ -22,6 +22,15 @@
 
 #define TAG "Application"
 
+// The value of a string item of root, nullopt if it is missing or not a string
+static std::optional<std::string_view> GetJsonString(const cJSON* root, const char* key) {
+    auto item = cJSON_GetObjectItem(root, key);
+    if (!cJSON_IsString(item)) {
+        return std::nullopt;
+    }
+    return std::string_view(item->valuestring);
+}
+
 
 static const char* const STATE_STRINGS[] = {
     "unknown",
@@ -40,6 +49,11 @@ static const char* const STATE_STRINGS[] = {
 
 extern QueueHandle_t upgrade_queue;
 
+// Realtime (AEC) sessions may use shorter uplink frames to cut the end-to-end latency
+static int GetUplinkFrameDuration(AecMode aec_mode) {
+    return aec_mode == kAecOff ? OPUS_FRAME_DURATION_MS : CONFIG_REALTIME_OPUS_FRAME_DURATION_MS;
+}
+
 
 
 Application::Application() {
@@ -225,7 +239,7 @@ void Application::ShowActivationCode(const std::string& code, const std::string&
         digit_sound{'9', Lang::Sounds::P3_9}
     }};
 
-    // This sentence uses 9KB of SRAM, so we need to wait for it to finish
+    // The digits are queued behind the activation sentence and played in order
     Alert(Lang::Strings::ACTIVATION, message.c_str(), "happy", Lang::Sounds::P3_ACTIVATION);
 
     for (const auto& digit : code) {
@@ -277,6 +291,8 @@ void Application::ToggleChatState() {
     }
 
     if (device_state_ == kDeviceStateIdle) {
+        // Power up the codec while the audio channel opens
+        audio_service_.PrepareAudio();
         Schedule([this]() {
             if (!protocol_->IsAudioChannelOpened()) {
                 SetDeviceState(kDeviceStateConnecting);
@@ -313,6 +329,8 @@ void Application::StartListening() {
     }
     
     if (device_state_ == kDeviceStateIdle) {
+        // Power up the codec while the audio channel opens
+        audio_service_.PrepareAudio();
         Schedule([this]() {
             if (!protocol_->IsAudioChannelOpened()) {
                 SetDeviceState(kDeviceStateConnecting);
@@ -370,6 +388,18 @@ void Application::Start() {
     audio_service_.Start();
     // 播放开机提示音
     audio_service_.PlaySound(Lang::Sounds::P3_STARTUP);
+#if CONFIG_PROMPT_CACHE_SIZE_KB > 0
+    // 预解码常用提示音，由解码任务在空闲时完成，不占用启动时间，播放时不再需要 Opus 解码
+    audio_service_.WarmPromptCache({
+#if CONFIG_PROMPT_CACHE_UI_SOUNDS
+        Lang::Sounds::P3_POPUP, Lang::Sounds::P3_CLICK, Lang::Sounds::P3_VIBRATION,
+#endif
+#if CONFIG_PROMPT_CACHE_DIGITS
+        Lang::Sounds::P3_0, Lang::Sounds::P3_1, Lang::Sounds::P3_2, Lang::Sounds::P3_3, Lang::Sounds::P3_4,
+        Lang::Sounds::P3_5, Lang::Sounds::P3_6, Lang::Sounds::P3_7, Lang::Sounds::P3_8, Lang::Sounds::P3_9,
+#endif
+    });
+#endif
     // 等待主页面加载 
     while (lv_screen_active() != display->scr_main_) {
         vTaskDelay(pdMS_TO_TICKS(50)); 
@@ -419,13 +449,15 @@ void Application::Start() {
         last_error_message_ = message;
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
-    protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+    protocol_->OnIncomingAudio([this](AudioStreamPacketPtr packet) {
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
+    protocol_->SetClientFrameDuration(GetUplinkFrameDuration(aec_mode_));
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         // board.SetPowerSaveMode(false); // 关闭此逻辑 
+        audio_service_.SetUplinkFrameDuration(protocol_->uplink_frame_duration());
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -439,93 +471,88 @@ void Application::Start() {
             SetDeviceState(kDeviceStateIdle);
         });
     });
+    protocol_->OnIncomingMessage([this](const ControlMessage& message) {
+        switch (message.type()) {
+            case kControlMessageTts:
+                HandleTtsMessage(message.GetString("state").value_or(""), message.GetString("text"));
+                break;
+            case kControlMessageStt:
+                HandleSttMessage(message.GetString("text"));
+                break;
+            case kControlMessageLlm:
+                HandleLlmMessage(message.GetString("emotion"));
+                break;
+            default:
+                break;
+        }
+    });
     protocol_->OnIncomingJson([this, display](const cJSON* root) {
         // Parse JSON data
         auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
-                        SetDeviceState(kDeviceStateSpeaking);
-                    }
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
+        if (!cJSON_IsString(type)) {
+            ESP_LOGW(TAG, "Missing message type");
+            return;
+        }
+        switch (LookupControlMessageType(type->valuestring)) {
+            case kControlMessageTts:
+                HandleTtsMessage(GetJsonString(root, "state").value_or(""), GetJsonString(root, "text"));
+                break;
+            case kControlMessageStt:
+                HandleSttMessage(GetJsonString(root, "text"));
+                break;
+            case kControlMessageLlm:
+                HandleLlmMessage(GetJsonString(root, "emotion"));
+                break;
+            case kControlMessageMcp: {
+                auto payload = cJSON_GetObjectItem(root, "payload");
+                if (cJSON_IsObject(payload)) {
+                    McpServer::GetInstance().ParseMessage(payload);
                 }
+                break;
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
-                McpServer::GetInstance().ParseMessage(payload);
+            case kControlMessageSystem: {
+                auto command = cJSON_GetObjectItem(root, "command");
+                if (cJSON_IsString(command)) {
+                    ESP_LOGI(TAG, "System command: %s", command->valuestring);
+                    if (strcmp(command->valuestring, "reboot") == 0) {
+                        // Do a reboot if user requests a OTA update
+                        Schedule([this]() {
+                            Reboot();
+                        });
+                    } else {
+                        ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+                    }
+                }
+                break;
             }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
-                    // Do a reboot if user requests a OTA update
-                    Schedule([this]() {
-                        Reboot();
-                    });
+            case kControlMessageAlert: {
+                auto status = cJSON_GetObjectItem(root, "status");
+                auto message = cJSON_GetObjectItem(root, "message");
+                auto emotion = cJSON_GetObjectItem(root, "emotion");
+                if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
+                    Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::P3_VIBRATION);
                 } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+                    ESP_LOGW(TAG, "Alert command requires status, message and emotion");
                 }
-            }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::P3_VIBRATION);
-            } else {
-                ESP_LOGW(TAG, "Alert command requires status, message and emotion");
+                break;
             }
 #if CONFIG_RECEIVE_CUSTOM_MESSAGE
-        } else if (strcmp(type->valuestring, "custom") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
-            if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
-                    display->SetChatMessage("system", payload_str.c_str());
-                });
-            } else {
-                ESP_LOGW(TAG, "Invalid custom message format: missing payload");
+            case kControlMessageCustom: {
+                auto payload = cJSON_GetObjectItem(root, "payload");
+                ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
+                if (cJSON_IsObject(payload)) {
+                    Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+                        display->SetChatMessage("system", payload_str.c_str());
+                    });
+                } else {
+                    ESP_LOGW(TAG, "Invalid custom message format: missing payload");
+                }
+                break;
             }
 #endif
-        } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+            default:
+                ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+                break;
         }
     });
     bool protocol_started = protocol_->Start();
@@ -549,6 +576,52 @@ void Application::Start() {
     SystemInfo::PrintHeapStats();
 }
 
+void Application::HandleTtsMessage(std::string_view state, std::optional<std::string_view> text) {
+    if (state == "start") {
+        Schedule([this]() {
+            aborted_ = false;
+            if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
+                SetDeviceState(kDeviceStateSpeaking);
+            }
+        });
+    } else if (state == "stop") {
+        Schedule([this]() {
+            if (device_state_ == kDeviceStateSpeaking) {
+                if (listening_mode_ == kListeningModeManualStop) {
+                    SetDeviceState(kDeviceStateIdle);
+                } else {
+                    SetDeviceState(kDeviceStateListening);
+                }
+            }
+        });
+    } else if (state == "sentence_start" && text) {
+        ESP_LOGI(TAG, "<< %.*s", int(text->size()), text->data());
+        Schedule([message = std::string(*text)]() {
+            auto display = Board::GetInstance().GetDisplay();
+            display->SetChatMessage("assistant", message.c_str());
+        });
+    }
+}
+
+void Application::HandleSttMessage(std::optional<std::string_view> text) {
+    if (text) {
+        ESP_LOGI(TAG, ">> %.*s", int(text->size()), text->data());
+        Schedule([message = std::string(*text)]() {
+            auto display = Board::GetInstance().GetDisplay();
+            display->SetChatMessage("user", message.c_str());
+        });
+    }
+}
+
+void Application::HandleLlmMessage(std::optional<std::string_view> emotion) {
+    if (emotion) {
+        Schedule([emotion_str = std::string(*emotion)]() {
+            auto display = Board::GetInstance().GetDisplay();
+            display->SetEmotion(emotion_str.c_str());
+        });
+    }
+}
+
 void Application::OnClockTimer() {
     clock_ticks_++;
 
@@ -561,6 +634,7 @@ void Application::OnClockTimer() {
         // SystemInfo::PrintTaskList();
         // Add for XiaoZhi-Card 
         SystemInfo::PrintHeapStats();
+        audio_service_.PrintStats();
     }
 }
 
@@ -593,9 +667,15 @@ void Application::MainEventLoop() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+                auto times = packet->times;
                 if (!protocol_->SendAudio(std::move(packet))) {
+                    // Sends fail by design while the channel is closed or still opening
+                    if (protocol_->IsAudioChannelOpened()) {
+                        audio_service_.RecordAudioSendFailed();
+                    }
                     break;
                 }
+                audio_service_.RecordAudioSent(times);
             }
         }
 
@@ -627,28 +707,64 @@ void Application::OnWakeWordDetected() {
     }
 
     if (device_state_ == kDeviceStateIdle) {
+        audio_service_.PrepareAudio();
+        bool channel_opened = protocol_->IsAudioChannelOpened();
+        if (!channel_opened) {
+            /* Capture what is said right after the wake word while the channel opens, the newest
+               AUDIO_QUEUE_DURATION_MS wait in the send queue and are flushed once the channel is open */
+            audio_service_.DiscardSendQueue();
+            audio_service_.HoldUplinkRateControl();
+            audio_service_.SetSendQueueOverwrite(true);
+            audio_service_.SetUplinkFrameDuration(protocol_->client_frame_duration());
+            audio_service_.EnableVoiceProcessing(true);
+            audio_service_.EnableWakeWordDetection(false);
+        }
+        // The wake word is encoded by its own task while the audio channel opens
         audio_service_.EncodeWakeWord();
 
-        if (!protocol_->IsAudioChannelOpened()) {
+        if (!channel_opened) {
             SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
+            int64_t open_start_time = esp_timer_get_time();
+            bool opened = protocol_->OpenAudioChannel();
+            audio_service_.SetSendQueueOverwrite(false);
+            if (!opened) {
+                audio_service_.EnableVoiceProcessing(false);
+                audio_service_.DiscardSendQueue();
                 audio_service_.EnableWakeWordDetection(true);
                 return;
             }
+            ESP_LOGI(TAG, "Audio channel opened in %ld ms", (long)((esp_timer_get_time() - open_start_time) / 1000));
+            if (protocol_->uplink_frame_duration() != protocol_->client_frame_duration()) {
+                /* The audio after the wake word was captured at the announced frame duration, restart the
+                   processor at the accepted one, the frames already queued are sent as they are */
+                audio_service_.EnableVoiceProcessing(true);
+            }
         }
 
         auto wake_word = audio_service_.GetLastWakeWord();
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
+        auto mode = aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime;
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
+        // Send the wake word data to the server
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            auto times = packet->times;
+            if (!protocol_->SendAudio(std::move(packet))) {
+                break;
+            }
+            audio_service_.RecordAudioSent(times);
         }
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
-#else
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+#endif
+        if (audio_service_.IsAudioProcessorRunning()) {
+            // Started early, SetListeningMode() only announces a processor it starts itself
+            listening_mode_ = mode;
+            protocol_->SendStartListening(mode);
+        }
+        SetListeningMode(mode);
+        // Flush the audio captured while the channel was opening
+        xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
+#if !CONFIG_USE_AFE_WAKE_WORD && !CONFIG_USE_CUSTOM_WAKE_WORD
         // Play the pop up sound to indicate the wake word is detected
         audio_service_.PlaySound(Lang::Sounds::P3_POPUP);
 #endif
@@ -841,15 +957,18 @@ void Application::SetAecMode(AecMode mode) {
             break;
         }
 
-        // If the AEC mode is changed, close the audio channel
-        if (protocol_ && protocol_->IsAudioChannelOpened()) {
-            protocol_->CloseAudioChannel();
+        // If the AEC mode is changed, close the audio channel, the next one uses the new frame duration
+        if (protocol_) {
+            protocol_->SetClientFrameDuration(GetUplinkFrameDuration(aec_mode_));
+            if (protocol_->IsAudioChannelOpened()) {
+                protocol_->CloseAudioChannel();
+            }
         }
     });
 }
 
-void Application::PlaySound(const std::string_view& sound) {
-    audio_service_.PlaySound(sound);
+SoundHandle Application::PlaySound(const std::string_view& sound) {
+    return audio_service_.PlaySound(sound);
 }
 
  
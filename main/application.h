@@ -11,6 +11,8 @@
 #include <deque>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <string_view>
 
 #include "protocol.h"
 #include "ota.h"
@@ -58,7 +60,7 @@ public:
     void SendMcpMessage(const std::string& payload);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
-    void PlaySound(const std::string_view& sound);
+    SoundHandle PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
     // Add for XiaoZhi-Card
     void PausePlay(bool enable) { audio_service_.Pause(enable); }
@@ -87,6 +89,9 @@ private:
     void ShowActivationCode(const std::string& code, const std::string& message);
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
+    void HandleTtsMessage(std::string_view state, std::optional<std::string_view> text);
+    void HandleSttMessage(std::optional<std::string_view> text);
+    void HandleLlmMessage(std::optional<std::string_view> emotion);
 };
 
 #endif // _APPLICATION_H_
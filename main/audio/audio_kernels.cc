@@ -0,0 +1,154 @@
+#include "audio_kernels.h"
+
+#include <algorithm>
+
+// Two packed samples, allowed to alias the int16_t buffers
+typedef uint32_t __attribute__((__may_alias__)) SamplePair;
+
+static inline bool IsWordAligned(const void* p) {
+    return (reinterpret_cast<uintptr_t>(p) & 0x3) == 0;
+}
+
+void DeinterleaveStereo(const int16_t* input, size_t frames, int16_t* left, int16_t* right) {
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (IsWordAligned(input) && IsWordAligned(left) && IsWordAligned(right)) {
+        // Each input word holds one frame: left in the low half, right in the high half
+        auto in = reinterpret_cast<const SamplePair*>(input);
+        auto l = reinterpret_cast<SamplePair*>(left);
+        auto r = reinterpret_cast<SamplePair*>(right);
+        for (size_t j = 0; i + 1 < frames; i += 2, j++) {
+            uint32_t w0 = in[i];
+            uint32_t w1 = in[i + 1];
+            l[j] = (w0 & 0xFFFF) | (w1 << 16);
+            r[j] = (w0 >> 16) | (w1 & 0xFFFF0000);
+        }
+    }
+#endif
+    for (; i < frames; i++) {
+        left[i] = input[2 * i];
+        right[i] = input[2 * i + 1];
+    }
+}
+
+void InterleaveStereo(const int16_t* left, const int16_t* right, size_t frames, int16_t* output) {
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (IsWordAligned(output) && IsWordAligned(left) && IsWordAligned(right)) {
+        auto out = reinterpret_cast<SamplePair*>(output);
+        auto l = reinterpret_cast<const SamplePair*>(left);
+        auto r = reinterpret_cast<const SamplePair*>(right);
+        for (size_t j = 0; i + 1 < frames; i += 2, j++) {
+            uint32_t lw = l[j];
+            uint32_t rw = r[j];
+            out[i] = (lw & 0xFFFF) | (rw << 16);
+            out[i + 1] = (lw >> 16) | (rw & 0xFFFF0000);
+        }
+    }
+#endif
+    for (; i < frames; i++) {
+        output[2 * i] = left[i];
+        output[2 * i + 1] = right[i];
+    }
+}
+
+size_t ResampleStereo(AudioResampler& left_resampler, AudioResampler& right_resampler,
+    const int16_t* input, size_t frames, int16_t* output, int16_t* scratch) {
+    size_t output_frames = left_resampler.GetOutputSamples(frames);
+    // Keep every scratch buffer word aligned
+    int16_t* left = scratch;
+    int16_t* right = left + RoundUpToEven(frames);
+    int16_t* resampled_left = right + RoundUpToEven(frames);
+    int16_t* resampled_right = resampled_left + RoundUpToEven(output_frames);
+
+    DeinterleaveStereo(input, frames, left, right);
+    left_resampler.Process(left, frames, resampled_left);
+    right_resampler.Process(right, frames, resampled_right);
+    InterleaveStereo(resampled_left, resampled_right, output_frames, output);
+    return output_frames;
+}
+
+void MixWithGainRamp(const int16_t* input, size_t samples, int32_t gain_start, int32_t gain_end, int32_t* accumulator) {
+    if (gain_start == gain_end) {
+        for (size_t i = 0; i < samples; i++) {
+            accumulator[i] += (int32_t(input[i]) * gain_start) >> 15;
+        }
+        return;
+    }
+    // The gain is stepped in Q23 to keep the ramp exact enough over a frame
+    int64_t gain = int64_t(gain_start) << 8;
+    int64_t step = ((int64_t(gain_end) - gain_start) << 8) / int64_t(samples);
+    for (size_t i = 0; i < samples; i++) {
+        accumulator[i] += (int32_t(input[i]) * int32_t(gain >> 8)) >> 15;
+        gain += step;
+    }
+}
+
+static inline int16_t Saturate16(int32_t sample) {
+    return sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample);
+}
+
+void SoftClipToPcm16(const int32_t* input, size_t samples, int16_t* output) {
+    constexpr int32_t range = INT16_MAX - SOFT_CLIP_KNEE;
+    for (size_t i = 0; i < samples; i++) {
+        int32_t sample = input[i];
+        int32_t magnitude = sample < 0 ? -sample : sample;
+        if (magnitude <= SOFT_CLIP_KNEE) {
+            output[i] = sample;
+            continue;
+        }
+        // Rational curve above the knee, its slope is 1 at the knee and it never reaches full scale
+        int32_t over = magnitude - SOFT_CLIP_KNEE;
+        int32_t limited = SOFT_CLIP_KNEE + int32_t(int64_t(over) * range / (over + range));
+        output[i] = sample < 0 ? -limited : limited;
+    }
+}
+
+bool NarrowToPcm16(const int32_t* input, size_t samples, int16_t* output) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t sample = input[i];
+        if (sample != int16_t(sample)) {
+            return false;
+        }
+        output[i] = sample;
+    }
+    return true;
+}
+
+void ScalePcm16ToPcm32(const int16_t* input, size_t samples, int32_t gain, int32_t* output) {
+    for (size_t i = 0; i < samples; i++) {
+        output[i] = int32_t(input[i]) * gain;
+    }
+}
+
+void ConvertPcm32ToPcm16(const int32_t* input, size_t samples, int shift, int16_t* output) {
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (IsWordAligned(output)) {
+        auto out = reinterpret_cast<SamplePair*>(output);
+        for (size_t j = 0; i + 1 < samples; i += 2, j++) {
+            int32_t low = std::clamp<int32_t>(input[i] >> shift, -INT16_MAX, INT16_MAX);
+            int32_t high = std::clamp<int32_t>(input[i + 1] >> shift, -INT16_MAX, INT16_MAX);
+            out[j] = (uint32_t(low) & 0xFFFF) | (uint32_t(high) << 16);
+        }
+    }
+#endif
+    for (; i < samples; i++) {
+        output[i] = std::clamp<int32_t>(input[i] >> shift, -INT16_MAX, INT16_MAX);
+    }
+}
+
+void ApplyGainPcm16(int16_t* samples, size_t count, int32_t gain) {
+    gain = std::clamp<int32_t>(gain, 0, 2 * AUDIO_GAIN_UNITY);
+    if (gain == AUDIO_GAIN_UNITY) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = Saturate16((int32_t(samples[i]) * gain) >> 15);
+    }
+}
+
+int32_t VolumeToGain(int volume) {
+    volume = std::clamp(volume, 0, 100);
+    return volume * volume * 65536 / (100 * 100);
+}
@@ -0,0 +1,69 @@
+#ifndef AUDIO_KERNELS_H
+#define AUDIO_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audio_resampler.h"
+
+/*
+ * Hot PCM loops shared by the audio pipeline. They only work on caller provided buffers
+ * and never allocate. Where the buffers are 32-bit aligned, two 16-bit samples are
+ * moved per load/store, otherwise a portable per-sample loop is used.
+ */
+
+// Split interleaved stereo into two mono buffers
+void DeinterleaveStereo(const int16_t* input, size_t frames, int16_t* left, int16_t* right);
+
+// Merge two mono buffers into interleaved stereo
+void InterleaveStereo(const int16_t* left, const int16_t* right, size_t frames, int16_t* output);
+
+inline size_t RoundUpToEven(size_t n) {
+    return (n + 1) & ~size_t(1);
+}
+
+// Number of scratch samples ResampleStereo() needs for the given input and output frames
+inline size_t GetResampleStereoScratchSamples(size_t input_frames, size_t output_frames) {
+    return 2 * RoundUpToEven(input_frames) + 2 * RoundUpToEven(output_frames);
+}
+
+/*
+ * Deinterleave -> resample each channel -> reinterleave in one pass through `scratch`.
+ * `output` may alias `input`, it is written only after the input has been consumed.
+ * The result is bit-exact with resampling each channel on its own.
+ * Returns the number of output frames.
+ */
+size_t ResampleStereo(AudioResampler& left_resampler, AudioResampler& right_resampler,
+    const int16_t* input, size_t frames, int16_t* output, int16_t* scratch);
+
+// Unity gain of the Q15 gains taken by the mixing kernels
+#define AUDIO_GAIN_UNITY 32768
+
+// accumulator += input * gain, the Q15 gain ramps linearly from gain_start towards gain_end
+void MixWithGainRamp(const int16_t* input, size_t samples, int32_t gain_start, int32_t gain_end, int32_t* accumulator);
+
+// Clamp to 16-bit, with a soft knee at SOFT_CLIP_KNEE so loud mixes are compressed instead of clipped
+#define SOFT_CLIP_KNEE 24576
+void SoftClipToPcm16(const int32_t* input, size_t samples, int16_t* output);
+
+// Copies the samples if all of them fit in 16 bits. Returns false at the first one that does not,
+// the output is partly written then.
+bool NarrowToPcm16(const int32_t* input, size_t samples, int16_t* output);
+
+/*
+ * Sample conversions of the codecs, for I2S slots wider than 16 bits.
+ */
+
+// output = input * gain, the Q16 gain must be within [0, 65536] so the product fits in 32 bits
+void ScalePcm16ToPcm32(const int16_t* input, size_t samples, int32_t gain, int32_t* output);
+
+// output = input >> shift, clamped to [-INT16_MAX, INT16_MAX]
+void ConvertPcm32ToPcm16(const int32_t* input, size_t samples, int shift, int16_t* output);
+
+// In place, the Q15 gain is clamped to [0, 2 * AUDIO_GAIN_UNITY], the result saturates
+void ApplyGainPcm16(int16_t* samples, size_t count, int32_t gain);
+
+// Q16 gain of an output volume of 0-100, on a square curve
+int32_t VolumeToGain(int volume);
+
+#endif // AUDIO_KERNELS_H
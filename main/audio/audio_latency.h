@@ -0,0 +1,81 @@
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <cstdint>
+
+/*
+ * Per-frame latency tracing of the audio pipeline.
+ *
+ * PCM tasks and Opus packets carry the esp_timer time at which they passed each stage, and
+ * the time between two stages is added to a LatencyHistogram when the later stage is reached.
+ * Each histogram is written by one task only, readers may see a frame being added.
+ */
+
+// Stage times of one frame in microseconds, 0 if the frame did not pass the stage
+struct AudioFrameTimes {
+    int64_t captured = 0;   // Uplink: the last mic chunk of the frame was read from the codec
+    int64_t processed = 0;  // Uplink: output by the audio processor, entered the encode queue
+    int64_t encoded = 0;
+    int64_t dequeued = 0;   // Uplink: popped from the send queue
+    int64_t received = 0;   // Downlink: entered the jitter buffer
+    int64_t decoded = 0;
+};
+
+#define LATENCY_HISTOGRAM_BUCKETS 10
+
+class LatencyHistogram {
+public:
+    // Upper bounds of the buckets in milliseconds, the last bucket collects everything above
+    static constexpr int kBucketLimitsMs[LATENCY_HISTOGRAM_BUCKETS - 1] = {2, 5, 10, 20, 50, 100, 200, 500, 1000};
+
+    void Add(int64_t latency_us) {
+        if (latency_us < 0) {
+            latency_us = 0;
+        }
+        int bucket = 0;
+        while (bucket < LATENCY_HISTOGRAM_BUCKETS - 1 && latency_us > kBucketLimitsMs[bucket] * 1000LL) {
+            bucket++;
+        }
+        buckets_[bucket]++;
+        count_++;
+        total_us_ += latency_us;
+        if (latency_us > max_us_) {
+            max_us_ = latency_us;
+        }
+    }
+
+    void Reset() {
+        for (auto& bucket : buckets_) {
+            bucket = 0;
+        }
+        count_ = 0;
+        total_us_ = 0;
+        max_us_ = 0;
+    }
+
+    inline uint32_t count() const { return count_; }
+    inline uint32_t bucket(int index) const { return buckets_[index]; }
+    inline int average_ms() const { return count_ > 0 ? total_us_ / count_ / 1000 : 0; }
+    inline int max_ms() const { return max_us_ / 1000; }
+
+    // Upper bound of the bucket that holds the given percentile, or the maximum for the last bucket
+    int PercentileMs(int percentile) const {
+        uint32_t target = (uint64_t(count_) * percentile + 99) / 100;
+        uint32_t seen = 0;
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+            seen += buckets_[i];
+            if (seen >= target && seen > 0) {
+                return kBucketLimitsMs[i] < max_ms() ? kBucketLimitsMs[i] : max_ms();
+            }
+        }
+        return max_ms();
+    }
+
+private:
+    uint32_t buckets_[LATENCY_HISTOGRAM_BUCKETS] = {};
+    uint32_t count_ = 0;
+    int64_t total_us_ = 0;
+    int64_t max_us_ = 0;
+};
+
+#endif // AUDIO_LATENCY_H
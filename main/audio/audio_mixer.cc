@@ -0,0 +1,130 @@
+#include "audio_mixer.h"
+#include "audio_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+static int32_t ToQ15(float gain) {
+    return int32_t(std::clamp(gain, 0.0f, AUDIO_MIXER_MAX_GAIN) * AUDIO_GAIN_UNITY);
+}
+
+AudioMixer::AudioMixer(int voices, size_t capacity) : voices_(voices), accumulator_(capacity) {
+    for (auto& voice : voices_) {
+        voice.ring.resize(capacity);
+        voice.gain = AUDIO_GAIN_UNITY;
+        voice.current_gain = AUDIO_GAIN_UNITY;
+    }
+    duck_gain_ = AUDIO_GAIN_UNITY;
+}
+
+void AudioMixer::SetGain(int voice, float gain) {
+    voices_[voice].gain = ToQ15(gain);
+}
+
+void AudioMixer::SetPriority(int voice, int priority) {
+    voices_[voice].priority = priority;
+}
+
+void AudioMixer::SetDucking(float gain) {
+    duck_gain_ = ToQ15(std::min(gain, 1.0f));
+}
+
+bool AudioMixer::Empty() const {
+    for (auto& voice : voices_) {
+        if (voice.count > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t AudioMixer::Write(int index, const int16_t* pcm, size_t samples) {
+    auto& voice = voices_[index];
+    size_t capacity = voice.ring.size();
+    samples = std::min(samples, capacity - voice.count);
+
+    size_t write = (voice.read + voice.count) % capacity;
+    size_t first = std::min(samples, capacity - write);
+    memcpy(&voice.ring[write], pcm, first * sizeof(int16_t));
+    memcpy(&voice.ring[0], pcm + first, (samples - first) * sizeof(int16_t));
+    voice.count += samples;
+    return samples;
+}
+
+void AudioMixer::Clear(int index) {
+    voices_[index].read = 0;
+    voices_[index].count = 0;
+}
+
+size_t AudioMixer::Mix(std::vector<int16_t>& output) {
+    size_t samples = accumulator_.size();
+    int top_priority = INT32_MIN;
+    for (auto& voice : voices_) {
+        if (voice.count > 0) {
+            samples = std::min(samples, voice.count);
+            top_priority = std::max(top_priority, voice.priority.load());
+        }
+    }
+    if (top_priority == INT32_MIN) {
+        output.clear();
+        return 0;
+    }
+
+    output.resize(samples);
+    if (MixSingleVoice(samples, output.data())) {
+        return samples;
+    }
+
+    std::fill_n(accumulator_.begin(), samples, 0);
+    int32_t duck_gain = duck_gain_;
+    for (auto& voice : voices_) {
+        if (voice.count == 0) {
+            continue;
+        }
+        int32_t target = voice.gain;
+        if (voice.priority < top_priority) {
+            target = (int64_t(target) * duck_gain) >> 15;
+        }
+
+        // The ring wraps at most once, split the ramp at the wrap point
+        size_t capacity = voice.ring.size();
+        size_t first = std::min(samples, capacity - voice.read);
+        int32_t middle = voice.current_gain + int32_t((int64_t(target) - voice.current_gain) * int64_t(first) / int64_t(samples));
+        MixWithGainRamp(&voice.ring[voice.read], first, voice.current_gain, middle, accumulator_.data());
+        if (first < samples) {
+            MixWithGainRamp(&voice.ring[0], samples - first, middle, target, accumulator_.data() + first);
+        }
+        voice.current_gain = target;
+        voice.read = (voice.read + samples) % capacity;
+        voice.count -= samples;
+    }
+
+    if (!NarrowToPcm16(accumulator_.data(), samples, output.data())) {
+        SoftClipToPcm16(accumulator_.data(), samples, output.data());
+    }
+    return samples;
+}
+
+bool AudioMixer::MixSingleVoice(size_t samples, int16_t* output) {
+    Voice* single = nullptr;
+    for (auto& voice : voices_) {
+        if (voice.count > 0) {
+            if (single != nullptr) {
+                return false;
+            }
+            single = &voice;
+        }
+    }
+    // The only voice has the top priority, it is never ducked
+    if (single == nullptr || single->gain != AUDIO_GAIN_UNITY || single->current_gain != AUDIO_GAIN_UNITY) {
+        return false;
+    }
+
+    size_t capacity = single->ring.size();
+    size_t first = std::min(samples, capacity - single->read);
+    memcpy(output, &single->ring[single->read], first * sizeof(int16_t));
+    memcpy(output + first, &single->ring[0], (samples - first) * sizeof(int16_t));
+    single->read = (single->read + samples) % capacity;
+    single->count -= samples;
+    return true;
+}
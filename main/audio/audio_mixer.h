@@ -0,0 +1,63 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Mixes a fixed number of PCM voices at the codec output sample rate.
+ *
+ * Every voice has its own buffer, gain and priority. While a voice is playing, the voices
+ * with a lower priority are ducked by the ducking gain. Gain changes are ramped over one
+ * mixed chunk, so ducking does not click. A chunk is only soft clipped if its sum overflows
+ * 16 bits, and a single voice at unity gain is copied as it is, so plain playback is bit-exact.
+ *
+ * The mixer is owned by the audio output task, only the gains, priorities and ducking may be
+ * changed from other tasks. All buffers are allocated in the constructor.
+ */
+
+// Highest gain of a voice, the Q15 gains must not overflow the 32-bit products
+#define AUDIO_MIXER_MAX_GAIN 2.0f
+
+class AudioMixer {
+public:
+    // Every voice buffers up to capacity samples, and Mix() returns up to capacity samples
+    AudioMixer(int voices, size_t capacity);
+
+    void SetGain(int voice, float gain);
+    void SetPriority(int voice, int priority);
+    void SetDucking(float gain);
+
+    size_t Available(int voice) const { return voices_[voice].count; }
+    size_t Space(int voice) const { return voices_[voice].ring.size() - voices_[voice].count; }
+    bool Empty() const;
+
+    // Returns the number of samples written, less than samples if the voice is full
+    size_t Write(int voice, const int16_t* pcm, size_t samples);
+    void Clear(int voice);
+
+    // Mixes every voice that has data for the same number of samples, the shortest of them,
+    // so a playing voice is never padded with silence. Returns the number of samples in output.
+    size_t Mix(std::vector<int16_t>& output);
+
+private:
+    struct Voice {
+        std::vector<int16_t> ring;
+        size_t read = 0;
+        size_t count = 0;
+        std::atomic<int> priority = 0;
+        std::atomic<int32_t> gain = 0;
+        int32_t current_gain = 0;   // Gain at the end of the last mixed chunk
+    };
+
+    std::vector<Voice> voices_;
+    std::vector<int32_t> accumulator_;
+    std::atomic<int32_t> duck_gain_;
+
+    // Copies the only voice with data to output if it plays at unity gain, returns false otherwise
+    bool MixSingleVoice(size_t samples, int16_t* output);
+};
+
+#endif // AUDIO_MIXER_H
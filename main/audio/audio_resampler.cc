@@ -0,0 +1,71 @@
+#include "audio_resampler.h"
+
+#include <cmath>
+#include <numeric>
+
+// Kaiser window shape, about 80 dB stopband attenuation with RESAMPLER_TAPS_PER_SAMPLE taps
+#define RESAMPLER_KAISER_BETA 7.5
+// Cutoff relative to the Nyquist frequency of the lower rate: flat to 0.875, 78 dB down from 1.02
+#define RESAMPLER_CUTOFF 0.93
+
+static double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+void DesignPolyphaseFilter(int up, int down, int taps, int16_t* coefficients) {
+    int length = up * taps;
+    double cutoff = RESAMPLER_CUTOFF * 0.5 / (up > down ? up : down);
+    double center = (length - 1) / 2.0;
+    std::vector<double> prototype(length);
+    for (int i = 0; i < length; i++) {
+        double t = i - center;
+        double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        double ratio = 2.0 * i / (length - 1) - 1.0;
+        double window = BesselI0(RESAMPLER_KAISER_BETA * sqrt(1.0 - ratio * ratio)) / BesselI0(RESAMPLER_KAISER_BETA);
+        prototype[i] = sinc * window;
+    }
+
+    // Every phase gets unity DC gain, the rounding error goes to its largest tap
+    for (int phase = 0; phase < up; phase++) {
+        double sum = 0;
+        for (int k = 0; k < taps; k++) {
+            sum += prototype[phase + k * up];
+        }
+        int16_t* output = coefficients + phase * taps;
+        int32_t total = 0;
+        int largest = 0;
+        for (int j = 0; j < taps; j++) {
+            output[j] = lround(prototype[phase + (taps - 1 - j) * up] / sum * 32768.0);
+            total += output[j];
+            if (abs(output[j]) > abs(output[largest])) {
+                largest = j;
+            }
+        }
+        output[largest] += 32768 - total;
+    }
+}
+
+std::unique_ptr<AudioResampler> CreateAudioResampler(int input_sample_rate, int output_sample_rate) {
+    if (input_sample_rate == output_sample_rate) {
+        return nullptr;
+    }
+
+    int divisor = std::gcd(input_sample_rate, output_sample_rate);
+    int up = output_sample_rate / divisor;
+    int down = input_sample_rate / divisor;
+    switch (up * 16 + down) {
+    case 3 * 16 + 2: return std::make_unique<PolyphaseResampler<3, 2>>();   // 16k -> 24k
+    case 2 * 16 + 3: return std::make_unique<PolyphaseResampler<2, 3>>();   // 24k -> 16k
+    case 3 * 16 + 1: return std::make_unique<PolyphaseResampler<3, 1>>();   // 16k -> 48k
+    case 1 * 16 + 3: return std::make_unique<PolyphaseResampler<1, 3>>();   // 48k -> 16k
+    case 2 * 16 + 1: return std::make_unique<PolyphaseResampler<2, 1>>();   // 24k -> 48k, 8k -> 16k
+    case 1 * 16 + 2: return std::make_unique<PolyphaseResampler<1, 2>>();   // 48k -> 24k, 16k -> 8k
+    }
+    return std::make_unique<GenericResampler>(input_sample_rate, output_sample_rate);
+}
@@ -0,0 +1,117 @@
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include <opus_resampler.h>
+
+/*
+ * Mono 16-bit resamplers of the audio pipeline, created by CreateAudioResampler().
+ *
+ * The sample rate pairs the boards actually run (16k <-> 24k, 16k <-> 48k, 24k <-> 48k) use a
+ * fixed-point polyphase FIR specialized on the up / down ratio, so the tap loops have a
+ * compile-time trip count and no per-sample division. Any other pair falls back to OpusResampler.
+ *
+ * Resamplers keep the filter history between calls, one instance per stream.
+ */
+class AudioResampler {
+public:
+    virtual ~AudioResampler() = default;
+
+    // Output samples of the next Process() call with input_samples
+    virtual int GetOutputSamples(int input_samples) const = 0;
+    // output may alias input
+    virtual void Process(const int16_t* input, int input_samples, int16_t* output) = 0;
+};
+
+// nullptr if both sample rates are the same
+std::unique_ptr<AudioResampler> CreateAudioResampler(int input_sample_rate, int output_sample_rate);
+
+// Length of the filter in samples of the lower rate, it sets the width of the transition band.
+// 64 taps keep the band up to 7/8 of the lower Nyquist frequency flat and reject aliases and
+// images by about 80 dB, a 48k -> 16k output sample takes 192 multiply-accumulates.
+#define RESAMPLER_TAPS_PER_SAMPLE 64
+
+// Windowed-sinc prototype filter split into `up` phases of `taps` Q15 coefficients each.
+// The coefficients of every phase are stored in reverse, to run forward over the input history.
+void DesignPolyphaseFilter(int up, int down, int taps, int16_t* coefficients);
+
+// Upsample by Up, low-pass, downsample by Down
+template <int Up, int Down>
+class PolyphaseResampler : public AudioResampler {
+public:
+    // The prototype filter spans RESAMPLER_TAPS_PER_SAMPLE samples of the lower of the two rates
+    static constexpr int kTaps = RESAMPLER_TAPS_PER_SAMPLE * (Up > Down ? Up : Down) / Up;
+
+    PolyphaseResampler() {
+        DesignPolyphaseFilter(Up, Down, kTaps, &coefficients_[0][0]);
+        history_.assign(kTaps - 1, 0);
+    }
+
+    virtual int GetOutputSamples(int input_samples) const override {
+        int end = input_samples * Up;
+        return end > position_ ? (end - position_ + Down - 1) / Down : 0;
+    }
+
+    virtual void Process(const int16_t* input, int input_samples, int16_t* output) override {
+        // The window of an output sample ends at its input sample, history_ holds the samples before the block
+        int count = GetOutputSamples(input_samples);
+        history_.resize(kTaps - 1 + input_samples);
+        memcpy(&history_[kTaps - 1], input, input_samples * sizeof(int16_t));
+
+        const int16_t* samples = history_.data();
+        int position = position_;
+        for (int i = 0; i < count; i++) {
+            output[i] = Convolve(coefficients_[position % Up], samples + position / Up);
+            position += Down;
+        }
+        position_ = position - input_samples * Up;
+
+        memmove(history_.data(), &history_[input_samples], (kTaps - 1) * sizeof(int16_t));
+        history_.resize(kTaps - 1);
+    }
+
+private:
+    int16_t coefficients_[Up][kTaps];
+    std::vector<int16_t> history_;
+    int position_ = 0;  // Next output sample in the upsampled domain, relative to the current block
+
+    static inline int16_t Convolve(const int16_t* coefficients, const int16_t* samples) {
+        // Two accumulators, so a dual MAC unit can interleave the products
+        int32_t even = 0;
+        int32_t odd = 0;
+        for (int k = 0; k + 1 < kTaps; k += 2) {
+            even += int32_t(coefficients[k]) * samples[k];
+            odd += int32_t(coefficients[k + 1]) * samples[k + 1];
+        }
+        if (kTaps & 1) {
+            even += int32_t(coefficients[kTaps - 1]) * samples[kTaps - 1];
+        }
+        int32_t sum = (even + odd + (1 << 14)) >> 15;
+        return sum > INT16_MAX ? INT16_MAX : (sum < INT16_MIN ? INT16_MIN : sum);
+    }
+};
+
+// Any other pair of sample rates
+class GenericResampler : public AudioResampler {
+public:
+    GenericResampler(int input_sample_rate, int output_sample_rate) {
+        resampler_.Configure(input_sample_rate, output_sample_rate);
+    }
+
+    virtual int GetOutputSamples(int input_samples) const override {
+        return resampler_.GetOutputSamples(input_samples);
+    }
+
+    virtual void Process(const int16_t* input, int input_samples, int16_t* output) override {
+        resampler_.Process(input, input_samples, output);
+    }
+
+private:
+    OpusResampler resampler_;
+};
+
+#endif // AUDIO_RESAMPLER_H
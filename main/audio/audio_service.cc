@@ -1,4 +1,5 @@
 #include "audio_service.h"
+#include "audio_kernels.h"
 #include <esp_log.h>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
@@ -34,22 +35,41 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_->Start();
 
     /* Setup the audio codec */
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    SetDecodeSampleRate(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    opus_encoder_ = std::make_unique<UplinkOpusEncoder>(16000, 1, OPUS_FRAME_DURATION_MS);
+    opus_encoder_->Apply(uplink_rate_controller_.settings());
+    audio_send_queue_.SetLimit(AUDIO_QUEUE_DURATION_MS / uplink_frame_duration_ms_);
+
+    /* Every mixer voice buffers one frame at the output sample rate */
+    size_t mixer_capacity = codec->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000;
+    audio_mixer_ = std::make_unique<AudioMixer>(kAudioVoiceCount, mixer_capacity);
+    audio_mixer_->SetPriority(kAudioVoiceSpeech, 0);
+    audio_mixer_->SetPriority(kAudioVoicePrompt, 1);
+    audio_mixer_->SetDucking(AUDIO_MIXER_DUCKING_GAIN);
+    mix_buffer_.reserve(mixer_capacity);
+
+#if CONFIG_PROMPT_CACHE_SIZE_KB > 0
+    prompt_cache_ = std::make_unique<PromptCache>(CONFIG_PROMPT_CACHE_SIZE_KB * 1024);
+#endif
 
     if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
+        input_resampler_ = CreateAudioResampler(codec->input_sample_rate(), 16000);
+        reference_resampler_ = CreateAudioResampler(codec->input_sample_rate(), 16000);
     }
 
-#if CONFIG_USE_AUDIO_PROCESSOR
+#if CONFIG_USE_SHARED_AFE
+    /* Wake word and voice processing are consumers of one AFE, see AfeFrontEnd */
+    auto afe_front_end = std::make_shared<AfeFrontEnd>();
+    audio_processor_ = std::make_unique<AfeAudioProcessor>(afe_front_end);
+#elif CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
 #else
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
-#if CONFIG_USE_AFE_WAKE_WORD
+#if CONFIG_USE_SHARED_AFE
+    wake_word_ = std::make_unique<AfeWakeWord>(afe_front_end);
+#elif CONFIG_USE_AFE_WAKE_WORD
     wake_word_ = std::make_unique<AfeWakeWord>();
 #elif CONFIG_USE_ESP_WAKE_WORD
     wake_word_ = std::make_unique<EspWakeWord>();
@@ -59,8 +79,8 @@ void AudioService::Initialize(AudioCodec* codec) {
     wake_word_ = nullptr;
 #endif
 
-    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+    audio_processor_->OnOutput([this](const int16_t* data, size_t samples) {
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, data, samples);
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
@@ -72,6 +92,7 @@ void AudioService::Initialize(AudioCodec* codec) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+            wake_word_detected_time_us_ = esp_timer_get_time();
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
@@ -81,7 +102,7 @@ void AudioService::Initialize(AudioCodec* codec) {
     esp_timer_create_args_t audio_power_timer_args = {
         .callback = [](void* arg) {
             AudioService* audio_service = (AudioService*)arg;
-            audio_service->CheckAndUpdateAudioPowerState();
+            audio_service->CheckAudioPowerDeadlines();
         },
         .arg = this,
         .dispatch_method = ESP_TIMER_TASK,
@@ -95,7 +116,18 @@ void AudioService::Start() {
     service_stopped_ = false;
     xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    esp_timer_start_periodic(audio_power_timer_, 1000000);
+    {
+        /* The codec may have been enabled before the service started, power it off if it stays unused */
+        std::lock_guard<std::mutex> lock(power_mutex_);
+        int64_t now = esp_timer_get_time();
+        bool enabled[kAudioDirectionCount] = {codec_->input_enabled(), codec_->output_enabled()};
+        for (int direction = 0; direction < kAudioDirectionCount; direction++) {
+            power_state_[direction] = enabled[direction] ? kAudioPowerActive : kAudioPowerOff;
+            last_active_time_us_[direction] = now;
+            power_on_time_us_[direction] = now;
+        }
+    }
+    CheckAudioPowerDeadlines();
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     /* Start the audio input task */
@@ -127,33 +159,54 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 3, &audio_output_task_handle_);
 #endif
 
+#if CONFIG_USE_SEPARATE_OPUS_TASKS
+    /* Start the opus encoder task */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusEncodeTask();
+        vTaskDelete(NULL);
+    }, "opus_encode", 2048 * 13, this, CONFIG_OPUS_ENCODE_TASK_PRIORITY, &opus_encode_task_handle_, OPUS_ENCODE_TASK_CORE);
+
+    /* Start the opus decoder task */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecodeTask();
+        vTaskDelete(NULL);
+    }, "opus_decode", 2048 * 6, this, CONFIG_OPUS_DECODE_TASK_PRIORITY, &opus_decode_task_handle_, OPUS_DECODE_TASK_CORE);
+#else
     /* Start the opus codec task */
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->OpusCodecTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_codec", 2048 * 13, this, 2, &opus_encode_task_handle_);
+    opus_decode_task_handle_ = opus_encode_task_handle_;
+#endif
 }
 
 void AudioService::Stop() {
-    esp_timer_stop(audio_power_timer_);
+    {
+        std::lock_guard<std::mutex> lock(power_mutex_);
+        esp_timer_stop(audio_power_timer_);
+        power_deadline_us_ = 0;
+    }
     service_stopped_ = true;
     xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    /* Clearing the queues also wakes up the tasks waiting on them, so they can exit */
+    audio_encode_queue_.RequestClear();
+    CancelSounds();
+    audio_jitter_buffer_.Clear();
+    audio_playback_queue_.RequestClear();
+    audio_prompt_queue_.RequestClear();
+    audio_testing_queue_.RequestClear();
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
-    if (!codec_->input_enabled()) {
-        codec_->EnableInput(true);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+    if (power_state_[kAudioDirectionInput] == kAudioPowerOff || !codec_->input_enabled()) {
+        PowerOnAudio(kAudioDirectionInput, false);
     }
 
     if (codec_->input_sample_rate() != sample_rate) {
@@ -162,25 +215,19 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
             return false;
         }
         if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
+            // Resample mic and reference channels in place, through the preallocated scratch buffer
+            size_t frames = data.size() / 2;
+            size_t output_frames = input_resampler_->GetOutputSamples(frames);
+            input_resample_buffer_.resize(GetResampleStereoScratchSamples(frames, output_frames));
+            if (output_frames > frames) {
+                data.resize(output_frames * 2);
             }
+            ResampleStereo(*input_resampler_, *reference_resampler_, data.data(), frames, data.data(), input_resample_buffer_.data());
+            data.resize(output_frames * 2);
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            input_resample_buffer_.resize(input_resampler_->GetOutputSamples(data.size()));
+            input_resampler_->Process(data.data(), data.size(), input_resample_buffer_.data());
+            data.assign(input_resample_buffer_.begin(), input_resample_buffer_.end());
         }
     } else {
         data.resize(samples);
@@ -189,8 +236,8 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
         }
     }
 
-    /* Update the last input time */
-    last_input_time_ = std::chrono::steady_clock::now();
+    MarkAudioActive(kAudioDirectionInput);
+    last_capture_time_us_ = last_active_time_us_[kAudioDirectionInput].load();
     debug_statistics_.input_count++;
 
 #if CONFIG_USE_AUDIO_DEBUGGER
@@ -205,6 +252,9 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    // Reused for every read, so the mic path does not allocate once it has grown to the frame size
+    std::vector<int16_t> data;
+
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -221,30 +271,27 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.Size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
             int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
+                    for (size_t i = 0, j = 0; j < data.size(); ++i, j += 2) {
+                        data[i] = data[j];
                     }
-                    data = std::move(mono_data);
+                    data.resize(data.size() / 2);
                 }
-                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
+                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, data.data(), data.size());
                 continue;
             }
         }
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
@@ -256,7 +303,6 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
@@ -274,186 +320,518 @@ void AudioService::AudioInputTask() {
 }
  
 void AudioService::AudioOutputTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
-        if (service_stopped_) {
-            break;
+    auto self = xTaskGetCurrentTaskHandle();
+    audio_playback_queue_.SetConsumerTask(self);
+    audio_prompt_queue_.SetConsumerTask(self);
+
+    // A decoded frame is moved into its mixer voice, possibly over several mix rounds
+    struct MixerInput {
+        SpscQueue<AudioTaskPtr>& queue;
+        AudioMixerVoice voice;
+        AudioTaskPtr task;
+        size_t offset = 0;
+    };
+    MixerInput inputs[] = {
+        {audio_playback_queue_, kAudioVoiceSpeech},
+        {audio_prompt_queue_, kAudioVoicePrompt},
+    };
+    AudioFrameTimes speech_times;
+    [[maybe_unused]] uint32_t speech_timestamp = 0;
+
+    while (!service_stopped_) {
+        if (playback_reset_requested_.exchange(false)) {
+            inputs[kAudioVoiceSpeech].task.reset();
+            audio_mixer_->Clear(kAudioVoiceSpeech);
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        for (auto& input : inputs) {
+            if (!input.task) {
+                if (!input.queue.Pop(input.task)) {
+                    continue;
+                }
+                input.offset = 0;
+            }
+            auto& pcm = input.task->pcm;
+            input.offset += audio_mixer_->Write(input.voice, pcm.data() + input.offset, pcm.size() - input.offset);
+            if (input.offset == pcm.size()) {
+                if (input.voice == kAudioVoiceSpeech) {
+                    speech_times = input.task->times;
+                    speech_timestamp = input.task->timestamp;
+                }
+                input.task.reset();
+            }
+        }
 
-        if (!codec_->output_enabled()) {
-            // Add for XiaoZhi-Card Board
-            if (!pause_) {
-                codec_->EnableOutput(true);
+        if (audio_mixer_->Mix(mix_buffer_) == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // Add for XiaoZhi-Card Board: the output stays disabled while paused
+        if (power_state_[kAudioDirectionOutput] == kAudioPowerOff || (!codec_->output_enabled() && !pause_)) {
+            PowerOnAudio(kAudioDirectionOutput, false);
+        }
+        codec_->OutputData(mix_buffer_);
+        if (speech_times.decoded > 0) {
+            int64_t now = esp_timer_get_time();
+            debug_statistics_.latency[kLatencyDownlinkPlayback].Add(now - speech_times.decoded);
+            if (speech_times.received > 0) {
+                debug_statistics_.latency[kLatencyDownlinkTotal].Add(now - speech_times.received);
             }
-            esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        } 
-        codec_->OutputData(task->pcm);
+            speech_times = {};
+        }
 
-        /* Update the last output time */
-        last_output_time_ = std::chrono::steady_clock::now();
+        MarkAudioActive(kAudioDirectionOutput);
         debug_statistics_.playback_count++;
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+        if (speech_timestamp > 0) {
+            timestamp_queue_.Push(uint32_t(speech_timestamp));
+            speech_timestamp = 0;
         }
 #endif
     }
 
+    audio_playback_queue_.SetConsumerTask(nullptr);
+    audio_prompt_queue_.SetConsumerTask(nullptr);
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
+void AudioService::AttachOpusEncoder(TaskHandle_t task) {
+    audio_encode_queue_.SetConsumerTask(task);
+    audio_send_queue_.SetProducerTask(task);
+    audio_testing_queue_.SetProducerTask(task);
+}
+
+void AudioService::AttachOpusDecoder(TaskHandle_t task) {
+    audio_jitter_buffer_.SetConsumerTask(task);
+    audio_testing_queue_.SetConsumerTask(task);
+    audio_playback_queue_.SetProducerTask(task);
+    audio_prompt_queue_.SetProducerTask(task);
+}
+
 void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
+    auto self = xTaskGetCurrentTaskHandle();
+    AttachOpusEncoder(self);
+    AttachOpusDecoder(self);
+
+    while (!service_stopped_) {
+        TickType_t wait = portMAX_DELAY;
+        bool busy = DecodeNextPacket(wait);
+        busy = DecodeNextSoundFrame() || busy;
+        busy = EncodeNextTask() || busy;
+        if (!busy) {
+            busy = WarmNextPrompt();
+        }
+        if (!busy) {
+            ulTaskNotifyTake(pdTRUE, wait);
+        }
+    }
+
+    AttachOpusEncoder(nullptr);
+    AttachOpusDecoder(nullptr);
+    ESP_LOGW(TAG, "Opus codec task stopped");
+}
+
+void AudioService::OpusEncodeTask() {
+    AttachOpusEncoder(xTaskGetCurrentTaskHandle());
+
+    while (!service_stopped_) {
+        if (!EncodeNextTask()) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         }
+    }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
+    AttachOpusEncoder(nullptr);
+    ESP_LOGW(TAG, "Opus encode task stopped");
+}
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
-            }
-            debug_statistics_.decode_count++;
-        }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
-            }
+void AudioService::OpusDecodeTask() {
+    AttachOpusDecoder(xTaskGetCurrentTaskHandle());
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
-                }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
-                }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
+    while (!service_stopped_) {
+        TickType_t wait = portMAX_DELAY;
+        bool busy = DecodeNextPacket(wait);
+        busy = DecodeNextSoundFrame() || busy;
+        if (!busy) {
+            busy = WarmNextPrompt();
+        }
+        if (!busy) {
+            ulTaskNotifyTake(pdTRUE, wait);
+        }
+    }
+
+    AttachOpusDecoder(nullptr);
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+// Decode the next frame from the jitter buffer, or play back the recorded testing audio.
+// Returns false if there was nothing to do, wait is shortened while the jitter buffer is buffering.
+bool AudioService::DecodeNextPacket(TickType_t& wait) {
+    if (decoder_reset_requested_.exchange(false)) {
+        for (auto& cached : opus_decoder_cache_) {
+            if (cached.decoder) {
+                cached.decoder->ResetState();
             }
-            debug_statistics_.encode_count++;
-            lock.lock();
         }
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    if (audio_playback_queue_.Full()) {
+        return false;
+    }
+
+    AudioStreamPacketPtr packet;
+    int wait_ms = 0;
+    auto result = audio_jitter_buffer_.Pop(packet, wait_ms);
+    if (result == kJitterBufferEmpty && audio_testing_playback_) {
+        if (audio_testing_queue_.Pop(packet)) {
+            result = kJitterBufferPacket;
+        } else {
+            audio_testing_playback_ = false;
+        }
+    }
+    if (result == kJitterBufferBuffering) {
+        wait = pdMS_TO_TICKS(wait_ms) + 1;
+        return false;
+    }
+    if (result == kJitterBufferEmpty) {
+        return false;
+    }
+
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    bool concealed = result == kJitterBufferLost;
+    if (!concealed) {
+        task->timestamp = packet->timestamp;
+        task->times = packet->times;
+        SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+    }
+
+    // Decode straight into the task, or into the scratch buffer if it needs resampling.
+    // An empty payload makes the decoder conceal the missing frame (PLC).
+    bool resample = output_resampler_ != nullptr;
+    auto& decoded = resample ? decode_buffer_ : task->pcm;
+    bool decoded_ok = concealed ? opus_decoder_->Decode(std::vector<uint8_t>(), decoded)
+        : opus_decoder_->Decode(std::move(packet->payload), decoded);
+    if (decoded_ok) {
+        if (resample) {
+            task->pcm.resize(output_resampler_->GetOutputSamples(decoded.size()));
+            output_resampler_->Process(decoded.data(), decoded.size(), task->pcm.data());
+        }
+        // Concealed frames have no times, they are not counted
+        if (task->times.received > 0) {
+            task->times.decoded = esp_timer_get_time();
+            debug_statistics_.latency[kLatencyDownlinkDecode].Add(task->times.decoded - task->times.received);
+        }
+        audio_playback_queue_.Push(std::move(task));
+    } else {
+        ESP_LOGE(TAG, "Failed to decode audio");
+    }
+    debug_statistics_.decode_count++;
+    return true;
+}
+
+// Decode the next frame of the local sounds into the prompt queue, with a decoder of its own,
+// so prompts are mixed over the downlink audio. Returns false if there was nothing to do.
+bool AudioService::DecodeNextSoundFrame() {
+    if (audio_prompt_queue_.Full()) {
+        return false;
+    }
+
+    SoundHandle sound;
+    std::string_view frame;
+    const int16_t* pcm = nullptr;
+    size_t samples = 0;
+    size_t frame_samples = codec_->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000;
+    while ((sound = CurrentSound()) != nullptr) {
+        if (sound->cached() ? sound->NextPcm(pcm, samples, frame_samples) : sound->NextFrame(frame)) {
+            break;
+        }
+        FinishSound(sound);
+    }
+    if (!sound) {
+        return false;
+    }
+
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    if (sound->cached()) {
+        // Cached prompts are already at the output sample rate
+        task->pcm.assign(pcm, pcm + samples);
+        audio_prompt_queue_.Push(std::move(task));
+        return true;
+    }
+
+    // The P3 sounds are 16kHz / 60ms
+    if (!prompt_decoder_) {
+        prompt_decoder_ = std::make_unique<OpusDecoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+        if (codec_->output_sample_rate() != 16000) {
+            prompt_resampler_ = CreateAudioResampler(16000, codec_->output_sample_rate());
+        }
+    }
+
+    // The decoder takes a vector, the frame is copied from flash into a scratch buffer that keeps its capacity
+    sound_payload_.assign(frame.begin(), frame.end());
+    bool resample = codec_->output_sample_rate() != 16000;
+    auto& decoded = resample ? decode_buffer_ : task->pcm;
+    if (!prompt_decoder_->Decode(std::move(sound_payload_), decoded)) {
+        ESP_LOGE(TAG, "Failed to decode sound");
+        return true;
+    }
+    if (resample) {
+        task->pcm.resize(prompt_resampler_->GetOutputSamples(decoded.size()));
+        prompt_resampler_->Process(decoded.data(), decoded.size(), task->pcm.data());
+    }
+    audio_prompt_queue_.Push(std::move(task));
+    return true;
+}
+
+// Encode the audio to send queue. Returns false if there was nothing to do.
+bool AudioService::EncodeNextTask() {
+    if (audio_send_queue_.Full() && !DropOldestSendPacket()) {
+        return false;
+    }
+
+    AudioTaskPtr task;
+    if (!audio_encode_queue_.Pop(task)) {
+        return false;
+    }
+
+    // The encoder follows the frame size of the processor
+    int frame_duration = task->pcm.size() * 1000 / 16000;
+    if (frame_duration != opus_encoder_duration_ms_ && frame_duration > 0) {
+        ESP_LOGI(TAG, "Opus encoder frame duration: %d ms", frame_duration);
+        opus_encoder_ = std::make_unique<UplinkOpusEncoder>(16000, 1, frame_duration);
+        opus_encoder_->Apply(uplink_rate_controller_.settings());
+        opus_encoder_duration_ms_ = frame_duration;
+    }
+
+    auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+    packet->frame_duration = frame_duration;
+    packet->sample_rate = 16000;
+    packet->timestamp = task->timestamp;
+    // Packets to the server are encoded behind the room for the transport header, which is filled in place
+    packet->headroom = task->type == kAudioTaskTypeEncodeToSendQueue ? AUDIO_STREAM_PACKET_HEADROOM : 0;
+    packet->payload.resize(packet->headroom);
+    int64_t encode_start_time = esp_timer_get_time();
+    if (!opus_encoder_->Encode(task->pcm, packet->payload, packet->headroom)) {
+        ESP_LOGE(TAG, "Failed to encode audio");
+        return true;
+    }
+    [[maybe_unused]] int64_t encode_time_us = esp_timer_get_time() - encode_start_time;
+
+    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+        packet->times = task->times;
+        packet->times.encoded = esp_timer_get_time();
+        auto& latency = debug_statistics_.latency;
+        if (packet->times.captured > 0) {
+            latency[kLatencyUplinkProcess].Add(packet->times.processed - packet->times.captured);
+        }
+        latency[kLatencyUplinkEncode].Add(packet->times.encoded - packet->times.processed);
+        audio_send_queue_.Push(std::move(packet));
+        if (callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
+#if CONFIG_USE_ADAPTIVE_UPLINK_BITRATE
+        /* The send queue depth measures the link, the encode time the CPU headroom. Frames queued
+           ahead of the audio channel say nothing about the link, they are left out. */
+        int backlog_ms = audio_send_queue_.Size() * frame_duration;
+        uint32_t send_failures = audio_send_failures_.exchange(0);
+        if (!uplink_rate_held_ && uplink_rate_controller_.OnFrameEncoded(frame_duration, encode_time_us,
+                backlog_ms, send_failures)) {
+            opus_encoder_->Apply(uplink_rate_controller_.settings());
+        }
+#endif
+    } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
+        if (!audio_testing_queue_.Push(std::move(packet))) {
+            ESP_LOGW(TAG, "Audio testing queue is full, dropping packet");
+        }
+    }
+    debug_statistics_.encode_count++;
+    return true;
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+    if (opus_decoder_ != nullptr && opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    /* Switch to a cached decoder with its state, or replace the least recently used one */
+    int64_t start_time = esp_timer_get_time();
+    OpusDecoderCacheEntry* entry = nullptr;
+    OpusDecoderCacheEntry* oldest = &opus_decoder_cache_[0];
+    for (auto& cached : opus_decoder_cache_) {
+        if (cached.decoder && cached.decoder->sample_rate() == sample_rate && cached.decoder->duration_ms() == frame_duration) {
+            entry = &cached;
+            break;
+        }
+        if (cached.last_used < oldest->last_used) {
+            oldest = &cached;
+        }
+    }
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    bool created = entry == nullptr;
+    if (created) {
+        entry = oldest;
+        entry->decoder.reset();
+        entry->decoder = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+        if (sample_rate != codec_->output_sample_rate()) {
+            ESP_LOGI(TAG, "Resampling audio from %d to %d", sample_rate, codec_->output_sample_rate());
+            entry->resampler = CreateAudioResampler(sample_rate, codec_->output_sample_rate());
+        } else {
+            entry->resampler.reset();
+        }
+    }
+    entry->last_used = ++opus_decoder_cache_clock_;
+    opus_decoder_ = entry->decoder.get();
+    output_resampler_ = entry->resampler.get();
+
+    int64_t elapsed = esp_timer_get_time() - start_time;
+    if (created) {
+        debug_statistics_.decoder_create_count++;
+        debug_statistics_.decoder_create_time_us += elapsed;
+    } else {
+        debug_statistics_.decoder_switch_count++;
+        debug_statistics_.decoder_switch_time_us += elapsed;
     }
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, const int16_t* pcm, size_t samples) {
+    auto task = audio_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    // The frame is a view owned by the caller, this is the only copy on its way to the encoder
+    task->pcm.assign(pcm, pcm + samples);
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        size_t pending = timestamp_queue_.Size();
+        uint32_t timestamp;
+        if (timestamp_queue_.Pop(timestamp)) {
+            if (pending <= MAX_TIMESTAMPS_IN_QUEUE) {
+                task->timestamp = timestamp;
+            } else {
+                ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", pending);
+            }
         }
-        timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue, wait for the opus encoder if it is full */
+    task->times.captured = last_capture_time_us_;
+    task->times.processed = esp_timer_get_time();
+    if (!audio_encode_queue_.Push(std::move(task))) {
+        audio_encode_queue_.SetProducerTask(xTaskGetCurrentTaskHandle());
+        while (!service_stopped_ && !audio_encode_queue_.Push(std::move(task))) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        audio_encode_queue_.SetProducerTask(nullptr);
+    }
 }
 
-bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
-            return false;
+// Called by the opus decoder task, the sound stays queued until FinishSound()
+SoundHandle AudioService::CurrentSound() {
+    std::lock_guard<std::mutex> lock(sound_mutex_);
+    return sound_queue_.empty() ? nullptr : sound_queue_.front();
+}
+
+void AudioService::FinishSound(const SoundHandle& sound) {
+    {
+        std::lock_guard<std::mutex> lock(sound_mutex_);
+        if (!sound_queue_.empty() && sound_queue_.front() == sound) {
+            sound_queue_.pop_front();
         }
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
+    sound->Finish();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+void AudioService::CancelSounds() {
+    std::lock_guard<std::mutex> lock(sound_mutex_);
+    for (auto& sound : sound_queue_) {
+        sound->Cancel();
+        sound->Finish();
+    }
+    sound_queue_.clear();
+}
+
+bool AudioService::PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait) {
+    packet->times.received = esp_timer_get_time();
+    if (audio_jitter_buffer_.Push(std::move(packet))) {
+        return true;
+    }
+    if (!wait) {
+        return false;
+    }
+
+    /* Wait for the opus decoder to make room, the timeout covers several waiting producers */
+    bool pushed = false;
+    audio_jitter_buffer_.SetProducerTask(xTaskGetCurrentTaskHandle());
+    while (!service_stopped_ && !(pushed = audio_jitter_buffer_.Push(std::move(packet)))) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS));
+    }
+    audio_jitter_buffer_.SetProducerTask(nullptr);
+    return pushed;
+}
+
+AudioStreamPacketPtr AudioService::PopPacketFromSendQueue() {
+    AudioStreamPacketPtr packet;
+    if (!audio_send_queue_.Pop(packet)) {
+        // What was queued while the audio channel opened is flushed
+        uplink_rate_held_ = false;
+        return packet;
+    }
+    if (packet->times.encoded > 0) {
+        packet->times.dequeued = esp_timer_get_time();
+        debug_statistics_.latency[kLatencyUplinkSendQueue].Add(packet->times.dequeued - packet->times.encoded);
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
+void AudioService::RecordAudioSent(const AudioFrameTimes& times) {
+    int64_t now = esp_timer_get_time();
+    if (wake_word_uplink_pending_.exchange(false)) {
+        int64_t latency_us = now - wake_word_detected_time_us_;
+        debug_statistics_.latency[kLatencyWakeWordToUplink].Add(latency_us);
+        ESP_LOGI(TAG, "Wake word to first uplink audio: %ld ms", (long)(latency_us / 1000));
+    }
+    if (times.dequeued == 0) {
+        return;
+    }
+    debug_statistics_.latency[kLatencyUplinkSend].Add(now - times.dequeued);
+    if (times.captured > 0) {
+        debug_statistics_.latency[kLatencyUplinkTotal].Add(now - times.captured);
+    }
+}
+
+void AudioService::DiscardSendQueue() {
+    wake_word_uplink_pending_ = false;
+    uplink_rate_held_ = false;
+    /* The clear is done by the consumer, which is the caller */
+    audio_send_queue_.RequestClear();
+    AudioStreamPacketPtr packet;
+    audio_send_queue_.Pop(packet);
+}
+
+void AudioService::SetSendQueueOverwrite(bool overwrite) {
+    std::lock_guard<std::mutex> lock(send_queue_overwrite_mutex_);
+    send_queue_overwrite_ = overwrite;
+}
+
+// Called by the opus codec task. The sender does not pop while the overwrite is set, so the encoder
+// can stand in as the consumer of the send queue. The newest audio is kept, the AFE is never stalled.
+bool AudioService::DropOldestSendPacket() {
+    std::lock_guard<std::mutex> lock(send_queue_overwrite_mutex_);
+    if (!send_queue_overwrite_) {
+        return false;
+    }
+    AudioStreamPacketPtr packet;
+    if (audio_send_queue_.Pop(packet)) {
+        debug_statistics_.stale_uplink_drops++;
+    }
+    return true;
+}
+
 void AudioService::EncodeWakeWord() {
+    wake_word_uplink_pending_ = wake_word_detected_time_us_ > 0;
     if (wake_word_) {
         wake_word_->EncodeWakeWordData();
     }
@@ -463,12 +841,8 @@ const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
-    if (wake_word_->GetWakeWordOpus(packet->payload)) {
-        return packet;
-    }
-    return nullptr;
+AudioStreamPacketPtr AudioService::PopWakeWordPacket() {
+    return wake_word_->GetWakeWordPacket();
 }
 
 void AudioService::EnableWakeWordDetection(bool enable) {
@@ -497,8 +871,14 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+            processor_frame_duration_ms_ = uplink_frame_duration_ms_;
+            audio_processor_->Initialize(codec_, processor_frame_duration_ms_);
             audio_processor_initialized_ = true;
+        } else if (processor_frame_duration_ms_ != uplink_frame_duration_ms_) {
+            /* The processor may still be running in realtime mode, the frame size is changed while it is stopped */
+            audio_processor_->Stop();
+            processor_frame_duration_ms_ = uplink_frame_duration_ms_;
+            audio_processor_->SetFrameDuration(processor_frame_duration_ms_);
         }
 
         /* We should make sure no audio is playing */
@@ -515,75 +895,347 @@ void AudioService::EnableVoiceProcessing(bool enable) {
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
     if (enable) {
+        audio_testing_playback_ = false;
+        audio_testing_queue_.RequestClear();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Let the opus decoder play back audio_testing_queue_ */
+        audio_testing_playback_ = true;
+        if (opus_decode_task_handle_ != nullptr) {
+            xTaskNotifyGive(opus_decode_task_handle_);
+        }
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+        processor_frame_duration_ms_ = uplink_frame_duration_ms_;
+        audio_processor_->Initialize(codec_, processor_frame_duration_ms_);
         audio_processor_initialized_ = true;
     }
 
     audio_processor_->EnableDeviceAec(enable);
 }
 
+void AudioService::SetUplinkFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        ESP_LOGE(TAG, "Unsupported frame duration: %d ms", frame_duration_ms);
+        return;
+    }
+    if (frame_duration_ms == uplink_frame_duration_ms_) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Uplink frame duration: %d ms", frame_duration_ms);
+    uplink_frame_duration_ms_ = frame_duration_ms;
+    audio_send_queue_.SetLimit(AUDIO_QUEUE_DURATION_MS / frame_duration_ms);
+    /* The processor switches to the new frame size when voice processing is enabled next */
+}
+
+void AudioService::WarmPromptCache(const std::vector<std::string_view>& sounds) {
+    if (!prompt_cache_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sound_mutex_);
+        prompt_cache_pending_.insert(prompt_cache_pending_.end(), sounds.begin(), sounds.end());
+        prompt_cache_warm_start_time_ = esp_timer_get_time();
+    }
+    if (opus_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(opus_decode_task_handle_);
+    }
+}
+
+// Decode the next pending prompt into the prompt cache, only called while the decoder has nothing else to do.
+// A prompt takes a few milliseconds, so downlink audio arriving meanwhile waits at most that long.
+bool AudioService::WarmNextPrompt() {
+    std::string_view sound;
+    {
+        std::lock_guard<std::mutex> lock(sound_mutex_);
+        if (prompt_cache_pending_.empty()) {
+            return false;
+        }
+        sound = prompt_cache_pending_.front();
+        prompt_cache_pending_.pop_front();
+    }
+
+    bool added = prompt_cache_->Add(sound, codec_->output_sample_rate());
+    std::lock_guard<std::mutex> lock(sound_mutex_);
+    if (!added) {
+        prompt_cache_pending_.clear();
+    }
+    if (prompt_cache_pending_.empty()) {
+        auto stats = prompt_cache_->GetStatistics();
+        ESP_LOGI(TAG, "Prompt cache warmed in %lld ms: %u prompts, %u/%u KB", (esp_timer_get_time() - prompt_cache_warm_start_time_) / 1000,
+            stats.entries, stats.bytes / 1024, stats.capacity_bytes / 1024);
+    }
+    return true;
+}
+
+void AudioService::SetVoiceGain(AudioMixerVoice voice, float gain) {
+    if (audio_mixer_) {
+        audio_mixer_->SetGain(voice, gain);
+    }
+}
+
 void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
-void AudioService::PlaySound(const std::string_view& sound) {
-    const char* data = sound.data();
-    size_t size = sound.size();
-    for (const char* p = data; p < data + size; ) {
-        auto p3 = (BinaryProtocol3*)p;
-        p += sizeof(BinaryProtocol3);
+void AudioService::PrintStats() {
+    auto& packet_pool = AudioStreamPacketPool::GetInstance();
+    ESP_LOGI(TAG, "%s pool: %u/%u in use, high watermark %u, exhausted %lu", audio_task_pool_.name(),
+        audio_task_pool_.in_use(), audio_task_pool_.capacity(), audio_task_pool_.high_watermark(), audio_task_pool_.exhausted_count());
+    ESP_LOGI(TAG, "%s pool: %u/%u in use, high watermark %u, exhausted %lu", packet_pool.name(),
+        packet_pool.in_use(), packet_pool.capacity(), packet_pool.high_watermark(), packet_pool.exhausted_count());
+
+    // avg / p95 / max in ms, since the last ResetLatencyStats()
+    auto& latency = debug_statistics_.latency;
+    ESP_LOGI(TAG, "Uplink latency (%lu frames): process %d/%d/%d, encode %d/%d/%d, send queue %d/%d/%d, send %d/%d/%d, total %d/%d/%d",
+        latency[kLatencyUplinkTotal].count(),
+        latency[kLatencyUplinkProcess].average_ms(), latency[kLatencyUplinkProcess].PercentileMs(95), latency[kLatencyUplinkProcess].max_ms(),
+        latency[kLatencyUplinkEncode].average_ms(), latency[kLatencyUplinkEncode].PercentileMs(95), latency[kLatencyUplinkEncode].max_ms(),
+        latency[kLatencyUplinkSendQueue].average_ms(), latency[kLatencyUplinkSendQueue].PercentileMs(95), latency[kLatencyUplinkSendQueue].max_ms(),
+        latency[kLatencyUplinkSend].average_ms(), latency[kLatencyUplinkSend].PercentileMs(95), latency[kLatencyUplinkSend].max_ms(),
+        latency[kLatencyUplinkTotal].average_ms(), latency[kLatencyUplinkTotal].PercentileMs(95), latency[kLatencyUplinkTotal].max_ms());
+    ESP_LOGI(TAG, "Downlink latency (%lu frames): decode %d/%d/%d, playback %d/%d/%d, total %d/%d/%d",
+        latency[kLatencyDownlinkTotal].count(),
+        latency[kLatencyDownlinkDecode].average_ms(), latency[kLatencyDownlinkDecode].PercentileMs(95), latency[kLatencyDownlinkDecode].max_ms(),
+        latency[kLatencyDownlinkPlayback].average_ms(), latency[kLatencyDownlinkPlayback].PercentileMs(95), latency[kLatencyDownlinkPlayback].max_ms(),
+        latency[kLatencyDownlinkTotal].average_ms(), latency[kLatencyDownlinkTotal].PercentileMs(95), latency[kLatencyDownlinkTotal].max_ms());
+    ESP_LOGI(TAG, "Wake word to uplink (%lu sessions): %d/%d/%d", latency[kLatencyWakeWordToUplink].count(),
+        latency[kLatencyWakeWordToUplink].average_ms(), latency[kLatencyWakeWordToUplink].PercentileMs(95), latency[kLatencyWakeWordToUplink].max_ms());
+
+    auto& stats = debug_statistics_;
+    ESP_LOGI(TAG, "Opus decoder cache: %lu switches (%lld us total), %lu created (%lld us total)",
+        stats.decoder_switch_count, stats.decoder_switch_time_us, stats.decoder_create_count, stats.decoder_create_time_us);
+    for (int direction = 0; direction < kAudioDirectionCount; direction++) {
+        auto& power = stats.power[direction];
+        ESP_LOGI(TAG, "Audio %s power: on %lu (%lu prepared), off %lu, first sample after %d/%d ms (avg/max)",
+            direction == kAudioDirectionInput ? "input" : "output", power.on_count, power.prepare_count,
+            power.off_count, power.first_sample.average_ms(), power.first_sample.max_ms());
+    }
+
+    if (prompt_cache_) {
+        auto cache = prompt_cache_->GetStatistics();
+        uint32_t lookups = cache.hits + cache.misses;
+        ESP_LOGI(TAG, "Prompt cache: %u prompts, %u/%u KB, hits %lu, misses %lu, hit rate %lu%%", cache.entries,
+            cache.bytes / 1024, cache.capacity_bytes / 1024, cache.hits, cache.misses, lookups > 0 ? cache.hits * 100 / lookups : 0);
+    }
+
+    auto jitter = audio_jitter_buffer_.GetStatistics();
+    ESP_LOGI(TAG, "Jitter buffer: received %lu, reordered %lu, late %lu, duplicate %lu, lost %lu, concealed %lu, underruns %lu, jitter %d ms, target delay %d ms",
+        jitter.received, jitter.reordered, jitter.late, jitter.duplicate, jitter.lost, jitter.concealed, jitter.underruns, jitter.jitter_ms, jitter.target_delay_ms);
+
+    auto uplink = uplink_rate_controller_.GetStatistics();
+    ESP_LOGI(TAG, "Uplink rate: %d bps, complexity %d, dtx %d, backlog %d ms, encode load %d%%, failed sends %lu, steps down %lu / up %lu, complexity limited %lu",
+        uplink.settings.bitrate, uplink.settings.complexity, uplink.settings.dtx, uplink.backlog_ms, uplink.encode_load,
+        uplink.send_failures, uplink.step_downs, uplink.step_ups, uplink.complexity_limits);
+}
+
+std::string AudioService::GetLatencyStatsJson() {
+    static const char* const stage_names[kLatencyStageCount] = {
+        "uplink_process", "uplink_encode", "uplink_send_queue", "uplink_send", "uplink_total",
+        "downlink_decode", "downlink_playback", "downlink_total", "wake_word_to_uplink",
+    };
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON* limits = cJSON_CreateArray();
+    for (int limit : LatencyHistogram::kBucketLimitsMs) {
+        cJSON_AddItemToArray(limits, cJSON_CreateNumber(limit));
+    }
+    cJSON_AddItemToObject(root, "bucket_limits_ms", limits);
+
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto& histogram = debug_statistics_.latency[i];
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", histogram.count());
+        cJSON_AddNumberToObject(stage, "avg_ms", histogram.average_ms());
+        cJSON_AddNumberToObject(stage, "p50_ms", histogram.PercentileMs(50));
+        cJSON_AddNumberToObject(stage, "p95_ms", histogram.PercentileMs(95));
+        cJSON_AddNumberToObject(stage, "max_ms", histogram.max_ms());
+        cJSON* buckets = cJSON_CreateArray();
+        for (int j = 0; j < LATENCY_HISTOGRAM_BUCKETS; j++) {
+            cJSON_AddItemToArray(buckets, cJSON_CreateNumber(histogram.bucket(j)));
+        }
+        cJSON_AddItemToObject(stage, "buckets", buckets);
+        cJSON_AddItemToObject(root, stage_names[i], stage);
+    }
+
+    auto uplink = uplink_rate_controller_.GetStatistics();
+    cJSON* uplink_rate = cJSON_CreateObject();
+    cJSON_AddNumberToObject(uplink_rate, "level", uplink.level);
+    cJSON_AddNumberToObject(uplink_rate, "bitrate", uplink.settings.bitrate);
+    cJSON_AddNumberToObject(uplink_rate, "complexity", uplink.settings.complexity);
+    cJSON_AddBoolToObject(uplink_rate, "dtx", uplink.settings.dtx);
+    cJSON_AddNumberToObject(uplink_rate, "backlog_ms", uplink.backlog_ms);
+    cJSON_AddNumberToObject(uplink_rate, "encode_load", uplink.encode_load);
+    cJSON_AddNumberToObject(uplink_rate, "send_failures", uplink.send_failures);
+    cJSON_AddNumberToObject(uplink_rate, "step_downs", uplink.step_downs);
+    cJSON_AddNumberToObject(uplink_rate, "step_ups", uplink.step_ups);
+    cJSON_AddNumberToObject(uplink_rate, "complexity_limits", uplink.complexity_limits);
+    cJSON_AddItemToObject(root, "uplink_rate", uplink_rate);
+    cJSON_AddNumberToObject(root, "stale_uplink_drops", debug_statistics_.stale_uplink_drops);
+
+    // Codec power transitions, and the time from enabling the codec to its first samples
+    for (int i = 0; i < kAudioDirectionCount; i++) {
+        auto& power = debug_statistics_.power[i];
+        cJSON* direction = cJSON_CreateObject();
+        cJSON_AddNumberToObject(direction, "on_count", power.on_count);
+        cJSON_AddNumberToObject(direction, "off_count", power.off_count);
+        cJSON_AddNumberToObject(direction, "prepare_count", power.prepare_count);
+        cJSON_AddNumberToObject(direction, "first_sample_avg_ms", power.first_sample.average_ms());
+        cJSON_AddNumberToObject(direction, "first_sample_max_ms", power.first_sample.max_ms());
+        cJSON_AddItemToObject(root, i == kAudioDirectionInput ? "input_power" : "output_power", direction);
+    }
 
-        auto payload_size = ntohs(p3->payload_size);
-        auto packet = std::make_unique<AudioStreamPacket>();
-        packet->sample_rate = 16000;
-        packet->frame_duration = 60;
-        packet->payload.resize(payload_size);
-        memcpy(packet->payload.data(), p3->payload, payload_size);
-        p += payload_size;
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
 
-        PushPacketToDecodeQueue(std::move(packet), true);
+void AudioService::ResetLatencyStats() {
+    for (auto& histogram : debug_statistics_.latency) {
+        histogram.Reset();
+    }
+    for (auto& power : debug_statistics_.power) {
+        power.first_sample.Reset();
     }
 }
 
+SoundHandle AudioService::PlaySound(const std::string_view& sound) {
+    const int16_t* pcm = nullptr;
+    size_t samples = 0;
+    if (prompt_cache_) {
+        prompt_cache_->Find(sound, codec_->output_sample_rate(), pcm, samples);
+    }
+    auto playback = std::make_shared<SoundPlayback>(sound, pcm, samples);
+    {
+        std::lock_guard<std::mutex> lock(sound_mutex_);
+        sound_queue_.push_back(playback);
+    }
+    if (opus_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(opus_decode_task_handle_);
+    }
+    return playback;
+}
+
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    {
+        std::lock_guard<std::mutex> lock(sound_mutex_);
+        if (!sound_queue_.empty()) {
+            return false;
+        }
+    }
+    return audio_encode_queue_.Empty() && audio_jitter_buffer_.Empty() && audio_playback_queue_.Empty() &&
+        audio_prompt_queue_.Empty() && audio_testing_queue_.Empty();
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
-}
-
-void AudioService::CheckAndUpdateAudioPowerState() {
-    auto now = std::chrono::steady_clock::now();
-    auto input_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_input_time_).count();
-    auto output_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_output_time_).count();
-    if (input_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->input_enabled()) {
-        codec_->EnableInput(false);
-    }
-    if (output_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->output_enabled()) {
-        codec_->EnableOutput(false);
-    }
-    if (!codec_->input_enabled() && !codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
+    /* The queues are flushed by their consumers, and the decoder is reset by the opus decoder task.
+       The jitter buffer is cleared right away, it is protected by its own lock. */
+    decoder_reset_requested_ = true;
+    audio_testing_playback_ = false;
+    timestamp_queue_.RequestClear();
+    audio_jitter_buffer_.Clear();
+    playback_reset_requested_ = true;
+    audio_playback_queue_.RequestClear();
+    audio_testing_queue_.RequestClear();
+}
+
+void AudioService::PrepareAudio() {
+    PowerOnAudio(kAudioDirectionInput, true);
+    PowerOnAudio(kAudioDirectionOutput, true);
+}
+
+void AudioService::PowerOnAudio(AudioDirection direction, bool prepare) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    int64_t now = esp_timer_get_time();
+    bool input = direction == kAudioDirectionInput;
+    bool enabled = input ? codec_->input_enabled() : codec_->output_enabled();
+    if (!enabled && (input || !pause_)) {
+        if (input) {
+            codec_->EnableInput(true);
+        } else {
+            codec_->EnableOutput(true);
+        }
+        auto& stats = debug_statistics_.power[direction];
+        stats.on_count++;
+        if (prepare) {
+            stats.prepare_count++;
+        }
+        power_on_time_us_[direction] = now;
+        power_state_[direction] = kAudioPowerResuming;
+        ESP_LOGD(TAG, "Audio %s enabled%s", input ? "input" : "output", prepare ? " ahead of use" : "");
+    } else if (power_state_[direction] == kAudioPowerOff) {
+        // Enabled by someone else, or paused, track it from now on
+        power_on_time_us_[direction] = now;
+        power_state_[direction] = kAudioPowerActive;
+    }
+    last_active_time_us_[direction] = now;
+    ArmPowerTimer(now + (input ? AUDIO_INPUT_POWER_OFF_DELAY_MS : AUDIO_OUTPUT_POWER_OFF_DELAY_MS) * 1000LL);
+}
+
+void AudioService::MarkAudioActive(AudioDirection direction) {
+    int64_t now = esp_timer_get_time();
+    last_active_time_us_[direction] = now;
+    auto state = kAudioPowerResuming;
+    if (power_state_[direction].compare_exchange_strong(state, kAudioPowerActive)) {
+        debug_statistics_.power[direction].first_sample.Add(now - power_on_time_us_[direction]);
+    }
+}
+
+void AudioService::ArmPowerTimer(int64_t deadline_us) {
+    /* Only an earlier deadline restarts the timer, a later one is picked up when it fires */
+    if (power_deadline_us_ != 0 && power_deadline_us_ <= deadline_us) {
+        return;
+    }
+    esp_timer_stop(audio_power_timer_);
+    esp_timer_start_once(audio_power_timer_, std::max<int64_t>(deadline_us - esp_timer_get_time(), 0));
+    power_deadline_us_ = deadline_us;
+}
+
+void AudioService::CheckAudioPowerDeadlines() {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    power_deadline_us_ = 0;
+
+    int64_t now = esp_timer_get_time();
+    int64_t next_deadline = 0;
+    for (int i = 0; i < kAudioDirectionCount; i++) {
+        auto direction = AudioDirection(i);
+        if (power_state_[direction] == kAudioPowerOff) {
+            continue;
+        }
+        bool input = direction == kAudioDirectionInput;
+        int64_t delay_us = (input ? AUDIO_INPUT_POWER_OFF_DELAY_MS : AUDIO_OUTPUT_POWER_OFF_DELAY_MS) * 1000LL;
+        int64_t deadline = std::max<int64_t>(last_active_time_us_[direction] + delay_us,
+            power_on_time_us_[direction] + AUDIO_POWER_MIN_ON_MS * 1000LL);
+        if (now < deadline) {
+            if (next_deadline == 0 || deadline < next_deadline) {
+                next_deadline = deadline;
+            }
+            continue;
+        }
+
+        bool enabled = input ? codec_->input_enabled() : codec_->output_enabled();
+        if (enabled) {
+            if (input) {
+                codec_->EnableInput(false);
+            } else {
+                codec_->EnableOutput(false);
+            }
+            debug_statistics_.power[direction].off_count++;
+            ESP_LOGD(TAG, "Audio %s disabled after %lld ms idle", input ? "input" : "output",
+                (now - last_active_time_us_[direction]) / 1000);
+        }
+        power_state_[direction] = kAudioPowerOff;
+    }
+
+    if (next_deadline != 0) {
+        ArmPowerTimer(next_deadline);
     }
 }
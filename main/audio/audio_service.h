@@ -2,22 +2,29 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <mutex>
+#include <deque>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
 
-#include <opus_encoder.h>
 #include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "audio_codec.h"
 #include "audio_processor.h"
+#include "audio_resampler.h"
+#include "spsc_queue.h"
+#include "frame_pool.h"
+#include "jitter_buffer.h"
+#include "audio_mixer.h"
+#include "sound_playback.h"
+#include "prompt_cache.h"
+#include "audio_latency.h"
+#include "uplink_encoder.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
@@ -26,24 +33,51 @@
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Jitter Buffer} -> [Opus Decoder] -> {Playback Queue} -> [Mixer] -> (Speaker)
+ *    (Local Sounds) -> [Prompt Opus Decoder] -> {Prompt Queue} -> [Mixer]
  *
  * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * With CONFIG_USE_SEPARATE_OPUS_TASKS, the encoder and decoder run in their own tasks, so
+ * a burst of downlink packets doesn't delay the uplink in full duplex mode.
  * 
- * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
- * 
+ * Jitter Buffer and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
+ *
+ * Every other queue is a bounded single-producer / single-consumer ring (see spsc_queue.h), so the
+ * producer and consumer of one queue never contend with the other queues, and waiting tasks
+ * are woken by task notifications instead of a shared condition variable.
  */
 
+// Default and longest uplink frame, the uplink frame duration is set per session by SetUplinkFrameDuration()
 #define OPUS_FRAME_DURATION_MS 60
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define MAX_PROMPT_TASKS_IN_QUEUE 2
+// The packet queue limits are in protocol.h, next to the packet pool they are sized against
+static_assert(MAX_WAKE_WORD_PACKETS > WAKE_WORD_PCM_DURATION_MS / OPUS_FRAME_DURATION_MS, "The packet pool must hold the wake word audio");
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
+#define MAX_AUDIO_TESTING_PACKETS_IN_QUEUE (AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS + MAX_ENCODE_TASKS_IN_QUEUE)
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+// Frames in the PCM queues, plus the ones held by the tasks touching them
+#define AUDIO_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + MAX_PLAYBACK_TASKS_IN_QUEUE + MAX_PROMPT_TASKS_IN_QUEUE + 6)
+
+#if CONFIG_USE_SEPARATE_OPUS_TASKS
+#define OPUS_ENCODE_TASK_CORE (CONFIG_OPUS_ENCODE_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_OPUS_ENCODE_TASK_CORE)
+#define OPUS_DECODE_TASK_CORE (CONFIG_OPUS_DECODE_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_OPUS_DECODE_TASK_CORE)
+#endif
+
+// Decoders kept per (sample rate, frame duration), e.g. local 16kHz prompts and 24kHz TTS
+#define OPUS_DECODER_CACHE_SIZE 2
+
+// Gain of the speech while a prompt is mixed over it
+#define AUDIO_MIXER_DUCKING_GAIN 0.3f
 
-#define AUDIO_POWER_TIMEOUT_MS 15000
-#define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+// Idle time before the codec input / output is disabled, and the least time it stays enabled
+#define AUDIO_INPUT_POWER_OFF_DELAY_MS CONFIG_AUDIO_INPUT_POWER_OFF_DELAY_MS
+#define AUDIO_OUTPUT_POWER_OFF_DELAY_MS CONFIG_AUDIO_OUTPUT_POWER_OFF_DELAY_MS
+#define AUDIO_POWER_MIN_ON_MS CONFIG_AUDIO_POWER_MIN_ON_MS
+
+// Longest wait for a reordered downlink packet before it is concealed
+#define AUDIO_REORDER_WINDOW_MS CONFIG_AUDIO_REORDER_WINDOW_MS
 
 
 #define AS_EVENT_AUDIO_TESTING_RUNNING      (1 << 0)
@@ -65,10 +99,64 @@ enum AudioTaskType {
     kAudioTaskTypeDecodeToPlaybackQueue,
 };
 
+// Voices of the output mixer, a higher priority voice ducks the lower ones
+enum AudioMixerVoice {
+    kAudioVoiceSpeech,      // Downlink audio from the server
+    kAudioVoicePrompt,      // Local sounds
+    kAudioVoiceCount,
+};
+
 struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    AudioFrameTimes times;
+
+    void Reset() {
+        pcm.clear();
+        timestamp = 0;
+        times = {};
+    }
+};
+
+using AudioTaskPtr = FramePool<AudioTask>::Handle;
+
+// Latency between two stages of AudioFrameTimes, the totals are from capture to send and from receive to playback
+enum LatencyStage {
+    kLatencyUplinkProcess,      // captured -> processed
+    kLatencyUplinkEncode,       // processed -> encoded
+    kLatencyUplinkSendQueue,    // encoded -> dequeued
+    kLatencyUplinkSend,         // dequeued -> sent by the protocol
+    kLatencyUplinkTotal,
+    kLatencyDownlinkDecode,     // received -> decoded, including the jitter buffer delay
+    kLatencyDownlinkPlayback,   // decoded -> written to the codec
+    kLatencyDownlinkTotal,
+    kLatencyWakeWordToUplink,   // wake word detected -> its first audio packet sent by the protocol
+    kLatencyStageCount,
+};
+
+enum AudioDirection {
+    kAudioDirectionInput,
+    kAudioDirectionOutput,
+    kAudioDirectionCount,
+};
+
+/*
+ * Power state of the codec input or output. The codec is enabled on demand or ahead of use by
+ * PrepareAudio(), and disabled by a one-shot timer armed to the earliest power off deadline,
+ * so nothing polls while the audio is in use.
+ */
+enum AudioPowerState {
+    kAudioPowerOff,
+    kAudioPowerResuming,    // Enabled, no samples read or written yet
+    kAudioPowerActive,
+};
+
+struct AudioPowerStatistics {
+    uint32_t on_count = 0;
+    uint32_t off_count = 0;
+    uint32_t prepare_count = 0;     // Enabled ahead of use by PrepareAudio()
+    LatencyHistogram first_sample;  // Enabled -> the first samples read or written
 };
 
 struct DebugStatistics {
@@ -76,6 +164,19 @@ struct DebugStatistics {
     uint32_t decode_count = 0;
     uint32_t encode_count = 0;
     uint32_t playback_count = 0;
+    LatencyHistogram latency[kLatencyStageCount];
+    uint32_t decoder_switch_count = 0;      // Switched to a cached decoder
+    uint32_t decoder_create_count = 0;      // Had to create a decoder
+    int64_t decoder_switch_time_us = 0;
+    int64_t decoder_create_time_us = 0;
+    uint32_t stale_uplink_drops = 0;        // Dropped from the full send queue while the channel opened
+    AudioPowerStatistics power[kAudioDirectionCount];
+};
+
+struct OpusDecoderCacheEntry {
+    std::unique_ptr<OpusDecoderWrapper> decoder;
+    std::unique_ptr<AudioResampler> resampler;  // nullptr if the decoder runs at the output sample rate
+    uint32_t last_used = 0;
 };
 
 class AudioService {
@@ -87,7 +188,7 @@ public:
     void Start();
     void Stop();
     void EncodeWakeWord();
-    std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
+    AudioStreamPacketPtr PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
     bool IsIdle();
@@ -99,13 +200,43 @@ public:
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
 
+    // 20, 40 or 60 ms, takes effect for the next frames the processor produces
+    void SetUplinkFrameDuration(int frame_duration_ms);
+    int uplink_frame_duration() const { return uplink_frame_duration_ms_; }
+
     void SetCallbacks(AudioServiceCallbacks& callbacks);
+    void PrintStats();
+    std::string GetLatencyStatsJson();
+    void ResetLatencyStats();
 
-    bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
-    void PlaySound(const std::string_view& sound);
+    bool PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait = false);
+    AudioStreamPacketPtr PopPacketFromSendQueue();
+    // Called by the sender once a packet from the send queue or of the wake word is on the wire
+    void RecordAudioSent(const AudioFrameTimes& times);
+    // Called by the sender when the session could not start, drops the queued packets
+    void DiscardSendQueue();
+    // Called by the sender when a packet could not be sent, lowers the uplink bitrate
+    void RecordAudioSendFailed() { audio_send_failures_++; }
+    // Called before frames are queued for an audio channel that is not open yet. The uplink rate
+    // controller ignores the send queue until the sender has drained it or discards it.
+    void HoldUplinkRateControl() { uplink_rate_held_ = true; }
+    // Called by the sender before it stops draining the send queue to open the audio channel, and again
+    // before it drains it. In between, the encoder drops the oldest packet of a full queue instead of waiting.
+    void SetSendQueueOverwrite(bool overwrite);
+    // Queues an embedded P3 sound and returns right away, the handle can cancel or wait for it.
+    // Sounds are mixed over the downlink audio, and are not dropped by ResetDecoder().
+    SoundHandle PlaySound(const std::string_view& sound);
+    // Queues the sounds to be decoded into the prompt cache, until it is full, and returns right away.
+    // The opus decoder task decodes them one by one while it has nothing else to do.
+    // Does nothing without CONFIG_PROMPT_CACHE_SIZE_KB.
+    void WarmPromptCache(const std::vector<std::string_view>& sounds);
+    // 0.0 to AUDIO_MIXER_MAX_GAIN, 1.0 by default
+    void SetVoiceGain(AudioMixerVoice voice, float gain);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    // Enables the codec input and output ahead of use, e.g. on a wake word or a button press,
+    // so the first samples of the session don't wait for the codec to power up
+    void PrepareAudio();
 
     // Add for XiaoZhi-Card
     void Pause(bool enable) { pause_ = enable; };
@@ -115,28 +246,60 @@ private:
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    std::unique_ptr<UplinkOpusEncoder> opus_encoder_;
+    UplinkRateController uplink_rate_controller_;
+    std::atomic<uint32_t> audio_send_failures_ = 0;
+    std::atomic<bool> uplink_rate_held_ = false;
+    // The current decoder and its resampler point into opus_decoder_cache_
+    OpusDecoderCacheEntry opus_decoder_cache_[OPUS_DECODER_CACHE_SIZE];
+    uint32_t opus_decoder_cache_clock_ = 0;
+    OpusDecoderWrapper* opus_decoder_ = nullptr;
+    AudioResampler* output_resampler_ = nullptr;
+    std::unique_ptr<OpusDecoderWrapper> prompt_decoder_;
+    std::unique_ptr<AudioResampler> prompt_resampler_;
+    std::unique_ptr<AudioMixer> audio_mixer_;
+    std::unique_ptr<PromptCache> prompt_cache_;
+    std::vector<int16_t> mix_buffer_;
+    std::unique_ptr<AudioResampler> input_resampler_;
+    std::unique_ptr<AudioResampler> reference_resampler_;
+    std::vector<int16_t> input_resample_buffer_;
     DebugStatistics debug_statistics_;
+    FramePool<AudioTask> audio_task_pool_{"audio_task", AUDIO_TASK_POOL_SIZE, [](AudioTask& task) {
+        task.pcm.reserve(OPUS_FRAME_DURATION_MS * 16000 / 1000);
+    }};
+    // Scratch buffers of the opus encoder / decoder, they keep their capacity between frames
+    std::vector<int16_t> decode_buffer_;
+    std::vector<uint8_t> sound_payload_;
 
     EventGroupHandle_t event_group_;
 
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    // Both point to the opus codec task, unless the encoder and decoder run in separate tasks
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    // Decode queue, reorders the downlink packets and reports the gaps to conceal
+    JitterBuffer audio_jitter_buffer_{MAX_DECODE_PACKETS_IN_QUEUE, AUDIO_QUEUE_DURATION_MS, AUDIO_REORDER_WINDOW_MS};
+    SpscQueue<AudioStreamPacketPtr> audio_send_queue_{MAX_SEND_PACKETS_IN_QUEUE};
+    SpscQueue<AudioStreamPacketPtr> audio_testing_queue_{MAX_AUDIO_TESTING_PACKETS_IN_QUEUE};
+    SpscQueue<AudioTaskPtr> audio_encode_queue_{MAX_ENCODE_TASKS_IN_QUEUE};
+    SpscQueue<AudioTaskPtr> audio_playback_queue_{MAX_PLAYBACK_TASKS_IN_QUEUE};
+    SpscQueue<AudioTaskPtr> audio_prompt_queue_{MAX_PROMPT_TASKS_IN_QUEUE};
+    // Local sounds, played in order by the opus decoder task
+    std::mutex sound_mutex_;
+    std::deque<SoundHandle> sound_queue_;
+    // Prompts still to be decoded into the prompt cache, under sound_mutex_
+    std::deque<std::string_view> prompt_cache_pending_;
+    int64_t prompt_cache_warm_start_time_ = 0;
     // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    SpscQueue<uint32_t> timestamp_queue_{MAX_TIMESTAMPS_IN_QUEUE * 2};
+    std::atomic<bool> decoder_reset_requested_ = false;
+    std::atomic<bool> playback_reset_requested_ = false;
+    std::atomic<bool> audio_testing_playback_ = false;
+    std::atomic<int> uplink_frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    int processor_frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    int opus_encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
@@ -144,16 +307,42 @@ private:
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
 
+    // Codec power, the states change under power_mutex_ except Resuming -> Active by the audio tasks
+    std::mutex power_mutex_;
+    // Held by the encoder while it drops from the send queue, on behalf of the sender
+    std::mutex send_queue_overwrite_mutex_;
+    bool send_queue_overwrite_ = false;
     esp_timer_handle_t audio_power_timer_ = nullptr;
-    std::chrono::steady_clock::time_point last_input_time_;
-    std::chrono::steady_clock::time_point last_output_time_;
+    std::atomic<AudioPowerState> power_state_[kAudioDirectionCount] = {};
+    std::atomic<int64_t> last_active_time_us_[kAudioDirectionCount] = {};
+    int64_t power_on_time_us_[kAudioDirectionCount] = {};
+    int64_t power_deadline_us_ = 0;     // The power timer fires then, 0 if it is not armed
+    std::atomic<int64_t> last_capture_time_us_ = 0;
+    // Armed by EncodeWakeWord(), until the first packet after the wake word is sent
+    std::atomic<int64_t> wake_word_detected_time_us_ = 0;
+    std::atomic<bool> wake_word_uplink_pending_ = false;
 
     void AudioInputTask();
     void AudioOutputTask();
     void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void OpusEncodeTask();
+    void OpusDecodeTask();
+    void AttachOpusEncoder(TaskHandle_t task);
+    void AttachOpusDecoder(TaskHandle_t task);
+    bool EncodeNextTask();
+    bool DropOldestSendPacket();
+    bool DecodeNextPacket(TickType_t& wait);
+    bool DecodeNextSoundFrame();
+    bool WarmNextPrompt();
+    SoundHandle CurrentSound();
+    void FinishSound(const SoundHandle& sound);
+    void CancelSounds();
+    void PushTaskToEncodeQueue(AudioTaskType type, const int16_t* pcm, size_t samples);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
-    void CheckAndUpdateAudioPowerState();
+    void PowerOnAudio(AudioDirection direction, bool prepare);
+    void MarkAudioActive(AudioDirection direction);
+    void ArmPowerTimer(int64_t deadline_us);
+    void CheckAudioPowerDeadlines();
 
     // Add for XiaoZhi-Card
     bool pause_ = false;
@@ -0,0 +1,195 @@
+#include "wav_file_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <cstring>
+
+#define TAG "WavFileAudioCodec"
+
+struct WavChunkHeader {
+    char id[4];
+    uint32_t size;
+} __attribute__((packed));
+
+struct WavFormat {
+    uint16_t audio_format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+} __attribute__((packed));
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    WavChunkHeader fmt_header;
+    WavFormat fmt;
+    WavChunkHeader data_header;
+} __attribute__((packed));
+
+WavFileAudioCodec::WavFileAudioCodec(const char* input_path, const char* output_path, int output_sample_rate, float speed)
+    : speed_(speed) {
+    duplex_ = true;
+    output_sample_rate_ = output_sample_rate;
+    output_channels_ = 1;
+
+    if (input_path != nullptr && !OpenInput(input_path)) {
+        ESP_LOGE(TAG, "Failed to open input file: %s", input_path);
+    }
+    if (output_path != nullptr && !OpenOutput(output_path)) {
+        ESP_LOGE(TAG, "Failed to open output file: %s", output_path);
+    }
+    ESP_LOGI(TAG, "WavFileAudioCodec initialized, input %d Hz x %d, output %d Hz, speed %.1f",
+        input_sample_rate_, input_channels_, output_sample_rate_, speed_);
+}
+
+WavFileAudioCodec::~WavFileAudioCodec() {
+    if (input_file_ != nullptr) {
+        fclose(input_file_);
+    }
+    if (output_file_ != nullptr) {
+        UpdateOutputHeader();
+        fclose(output_file_);
+    }
+}
+
+bool WavFileAudioCodec::OpenInput(const char* path) {
+    input_file_ = fopen(path, "rb");
+    if (input_file_ == nullptr) {
+        return false;
+    }
+
+    char riff[12];
+    if (fread(riff, 1, sizeof(riff), input_file_) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "Not a WAV file: %s", path);
+        fclose(input_file_);
+        input_file_ = nullptr;
+        return false;
+    }
+
+    /* Walk the chunks until the data chunk, the file position is then at the first sample */
+    bool has_format = false;
+    WavChunkHeader chunk;
+    while (fread(&chunk, 1, sizeof(chunk), input_file_) == sizeof(chunk)) {
+        if (memcmp(chunk.id, "fmt ", 4) == 0) {
+            WavFormat format;
+            if (chunk.size < sizeof(format) || fread(&format, 1, sizeof(format), input_file_) != sizeof(format)) {
+                break;
+            }
+            if (format.audio_format != 1 || format.bits_per_sample != 16 || format.channels < 1 || format.channels > 2) {
+                ESP_LOGE(TAG, "Unsupported WAV format: %u, %u bits, %u channels",
+                    format.audio_format, format.bits_per_sample, format.channels);
+                break;
+            }
+            input_sample_rate_ = format.sample_rate;
+            input_channels_ = format.channels;
+            // The second channel is used as the AEC reference, like on the boards with a loopback channel
+            input_reference_ = format.channels == 2;
+            has_format = true;
+            fseek(input_file_, chunk.size - sizeof(format) + (chunk.size & 1), SEEK_CUR);
+        } else if (memcmp(chunk.id, "data", 4) == 0) {
+            if (has_format) {
+                return true;
+            }
+            break;
+        } else {
+            fseek(input_file_, chunk.size + (chunk.size & 1), SEEK_CUR);
+        }
+    }
+
+    ESP_LOGE(TAG, "Invalid WAV file: %s", path);
+    fclose(input_file_);
+    input_file_ = nullptr;
+    return false;
+}
+
+bool WavFileAudioCodec::OpenOutput(const char* path) {
+    output_file_ = fopen(path, "wb");
+    if (output_file_ == nullptr) {
+        return false;
+    }
+    // Written again with the final sizes when the output is disabled or the codec is destroyed
+    UpdateOutputHeader();
+    return true;
+}
+
+void WavFileAudioCodec::UpdateOutputHeader() {
+    WavHeader header;
+    memcpy(header.riff, "RIFF", 4);
+    header.riff_size = sizeof(WavHeader) - 8 + output_data_size_;
+    memcpy(header.wave, "WAVE", 4);
+    memcpy(header.fmt_header.id, "fmt ", 4);
+    header.fmt_header.size = sizeof(WavFormat);
+    header.fmt.audio_format = 1;
+    header.fmt.channels = output_channels_;
+    header.fmt.sample_rate = output_sample_rate_;
+    header.fmt.byte_rate = output_sample_rate_ * output_channels_ * sizeof(int16_t);
+    header.fmt.block_align = output_channels_ * sizeof(int16_t);
+    header.fmt.bits_per_sample = 16;
+    memcpy(header.data_header.id, "data", 4);
+    header.data_header.size = output_data_size_;
+
+    long position = ftell(output_file_);
+    fseek(output_file_, 0, SEEK_SET);
+    fwrite(&header, 1, sizeof(header), output_file_);
+    if (position > (long)sizeof(header)) {
+        fseek(output_file_, position, SEEK_SET);
+    }
+    fflush(output_file_);
+}
+
+void WavFileAudioCodec::EnableOutput(bool enable) {
+    if (!enable && output_file_ != nullptr) {
+        UpdateOutputHeader();
+    }
+    AudioCodec::EnableOutput(enable);
+}
+
+void WavFileAudioCodec::Pace(int64_t& start_time, uint64_t& samples, int count, int sample_rate, int channels) {
+    if (speed_ <= 0 || sample_rate <= 0) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t due = start_time + int64_t(samples * 1000000 / (sample_rate * channels) / speed_);
+    // Start over after a pause, e.g. when the input or output was disabled
+    if (samples == 0 || now - due > 100 * 1000) {
+        start_time = now;
+        samples = 0;
+        due = now;
+    }
+    samples += count;
+    if (due > now) {
+        vTaskDelay(pdMS_TO_TICKS((due - now) / 1000));
+    }
+}
+
+int WavFileAudioCodec::Read(int16_t* dest, int samples) {
+    Pace(input_start_time_, input_samples_, samples, input_sample_rate_, input_channels_);
+
+    size_t read = 0;
+    if (input_file_ != nullptr && !input_ended_) {
+        read = fread(dest, sizeof(int16_t), samples, input_file_);
+        if (read < (size_t)samples) {
+            ESP_LOGI(TAG, "Input file ended, reading silence");
+            input_ended_ = true;
+        }
+    }
+    memset(dest + read, 0, (samples - read) * sizeof(int16_t));
+    return samples;
+}
+
+int WavFileAudioCodec::Write(const int16_t* data, int samples) {
+    Pace(output_start_time_, output_samples_, samples, output_sample_rate_, output_channels_);
+
+    if (output_file_ == nullptr) {
+        return samples;
+    }
+    size_t written = fwrite(data, sizeof(int16_t), samples, output_file_);
+    output_data_size_ += written * sizeof(int16_t);
+    return written;
+}
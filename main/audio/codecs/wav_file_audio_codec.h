@@ -0,0 +1,45 @@
+#ifndef _WAV_FILE_AUDIO_CODEC_H
+#define _WAV_FILE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdio>
+
+/*
+ * Audio codec backed by WAV files instead of I2S, for reproducible runs of the audio pipeline.
+ *
+ * The mic input is read from a 16-bit PCM WAV file (mono, or stereo with the reference
+ * channel), the speaker output is written to a mono 16-bit WAV file. The paths can be on
+ * any mounted VFS, e.g. SPIFFS or an SD card. Once the input file ends, silence is read.
+ *
+ * speed paces Read() and Write() against esp_timer: 1.0 is real time, 4.0 is four times
+ * faster, and 0 does not pace at all.
+ */
+class WavFileAudioCodec : public AudioCodec {
+private:
+    FILE* input_file_ = nullptr;
+    FILE* output_file_ = nullptr;
+    uint32_t output_data_size_ = 0;
+    float speed_;
+    int64_t input_start_time_ = 0;
+    uint64_t input_samples_ = 0;
+    int64_t output_start_time_ = 0;
+    uint64_t output_samples_ = 0;
+    bool input_ended_ = false;
+
+    bool OpenInput(const char* path);
+    bool OpenOutput(const char* path);
+    void UpdateOutputHeader();
+    void Pace(int64_t& start_time, uint64_t& samples, int count, int sample_rate, int channels);
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+
+public:
+    WavFileAudioCodec(const char* input_path, const char* output_path, int output_sample_rate, float speed = 1.0f);
+    virtual ~WavFileAudioCodec();
+
+    virtual void EnableOutput(bool enable) override;
+};
+
+#endif // _WAV_FILE_AUDIO_CODEC_H
@@ -0,0 +1,85 @@
+#ifndef FRAME_ASSEMBLER_H
+#define FRAME_ASSEMBLER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Cuts a stream of PCM chunks into frames of a fixed size, e.g. 32ms AFE fetches into 60ms frames.
+ *
+ * The frames are passed to the handler as views that stay valid until it returns. A frame that
+ * lies within one chunk while nothing is pending is passed in place, the others are assembled in
+ * a buffer of one frame, allocated up front. Samples are copied at most once and never shifted.
+ *
+ * With a stride, only every stride-th sample is taken, e.g. the first channel of interleaved stereo.
+ * Those frames are always assembled in the buffer.
+ */
+class FrameAssembler {
+public:
+    explicit FrameAssembler(size_t frame_samples = 0) {
+        SetFrameSamples(frame_samples);
+    }
+
+    // Drops the pending samples
+    void SetFrameSamples(size_t frame_samples) {
+        frame_samples_ = frame_samples;
+        buffer_.resize(frame_samples);
+        pending_ = 0;
+    }
+
+    inline size_t frame_samples() const { return frame_samples_; }
+    inline size_t pending() const { return pending_; }
+    inline void Reset() { pending_ = 0; }
+
+    // handler(const int16_t* frame, size_t samples) is called for every complete frame.
+    // Returns the number of frames.
+    template <typename Handler>
+    int Push(const int16_t* data, size_t samples, Handler&& handler, int stride = 1) {
+        if (frame_samples_ == 0) {
+            return 0;
+        }
+
+        int frames = 0;
+        if (stride > 1) {
+            for (size_t i = 0; i < samples; i += stride) {
+                buffer_[pending_++] = data[i];
+                if (pending_ == frame_samples_) {
+                    handler(buffer_.data(), frame_samples_);
+                    pending_ = 0;
+                    frames++;
+                }
+            }
+            return frames;
+        }
+
+        size_t offset = 0;
+        while (offset < samples) {
+            size_t available = samples - offset;
+            if (pending_ == 0 && available >= frame_samples_) {
+                handler(data + offset, frame_samples_);
+                offset += frame_samples_;
+                frames++;
+                continue;
+            }
+            size_t count = frame_samples_ - pending_ < available ? frame_samples_ - pending_ : available;
+            memcpy(buffer_.data() + pending_, data + offset, count * sizeof(int16_t));
+            pending_ += count;
+            offset += count;
+            if (pending_ == frame_samples_) {
+                handler(buffer_.data(), frame_samples_);
+                pending_ = 0;
+                frames++;
+            }
+        }
+        return frames;
+    }
+
+private:
+    std::vector<int16_t> buffer_;
+    size_t frame_samples_ = 0;
+    size_t pending_ = 0;
+};
+
+#endif // FRAME_ASSEMBLER_H
@@ -0,0 +1,101 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed-capacity pool of preallocated frames (PCM tasks, Opus packets).
+ *
+ * Acquire() hands out a unique_ptr whose deleter returns the frame to the pool instead
+ * of freeing it, so buffers keep their capacity and the steady-state pipeline does not
+ * touch the heap. T must provide Reset(), which clears the frame without releasing memory.
+ *
+ * When the pool is exhausted a heap allocated frame is returned, so the pipeline keeps
+ * running, and the exhaustion is counted.
+ */
+template <typename T>
+class FramePool {
+public:
+    class Recycler {
+    public:
+        Recycler(FramePool* pool = nullptr) : pool_(pool) {}
+        void operator()(T* item) const {
+            if (pool_ != nullptr) {
+                pool_->Release(item);
+            } else {
+                delete item;
+            }
+        }
+
+    private:
+        FramePool* pool_;
+    };
+    using Handle = std::unique_ptr<T, Recycler>;
+
+    FramePool(const char* name, size_t capacity, std::function<void(T&)> initializer = nullptr)
+        : name_(name), items_(capacity) {
+        free_items_.reserve(capacity);
+        for (auto& item : items_) {
+            if (initializer) {
+                initializer(item);
+            }
+            free_items_.push_back(&item);
+        }
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    Handle Acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_items_.empty()) {
+                T* item = free_items_.back();
+                free_items_.pop_back();
+                size_t in_use = items_.size() - free_items_.size();
+                if (in_use > high_watermark_) {
+                    high_watermark_ = in_use;
+                }
+                return Handle(item, Recycler(this));
+            }
+            exhausted_count_++;
+        }
+        return Handle(new T(), Recycler(nullptr));
+    }
+
+    inline const char* name() const { return name_; }
+    inline size_t capacity() const { return items_.size(); }
+    size_t in_use() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size() - free_items_.size();
+    }
+    size_t high_watermark() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return high_watermark_;
+    }
+    uint32_t exhausted_count() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return exhausted_count_;
+    }
+
+private:
+    const char* name_;
+    std::vector<T> items_;
+    std::vector<T*> free_items_;
+    std::mutex mutex_;
+    size_t high_watermark_ = 0;
+    uint32_t exhausted_count_ = 0;
+
+    void Release(T* item) {
+        item->Reset();
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_items_.push_back(item);
+    }
+};
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,229 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+#include <esp_timer.h>
+
+JitterBuffer::JitterBuffer(size_t capacity, int max_duration_ms, int reorder_window_ms)
+    : slots_(capacity), max_duration_ms_(max_duration_ms), reorder_window_ms_(reorder_window_ms) {
+}
+
+size_t JitterBuffer::Size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+bool JitterBuffer::Push(AudioStreamPacketPtr&& packet) {
+    int64_t now_us = esp_timer_get_time();
+    int64_t arrival_us = packet->times.received > 0 ? packet->times.received : now_us;
+    TaskHandle_t consumer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int32_t capacity = slots_.size();
+        uint32_t sequence = packet->has_sequence ? packet->sequence : last_sequence_ + 1;
+        if (packet->frame_duration > 0) {
+            frame_duration_ms_ = packet->frame_duration;
+        }
+
+        if (state_ == kStateIdle) {
+            Restart(sequence, arrival_us);
+        } else if (count_ == 0 && drained_time_us_ != 0) {
+            /* The stream resumes after the buffer ran dry */
+            int32_t skipped = sequence - next_sequence_;
+            bool underrun = packet->has_sequence && arrival_us - drained_time_us_ < JITTER_BUFFER_UNDERRUN_GAP_MS * 1000LL;
+            if (underrun && skipped < 0 && skipped > -capacity) {
+                statistics_.late++;
+                packet.reset();
+                return true;
+            }
+            if (underrun) {
+                statistics_.underruns++;
+                underrun_delay_ms_ = std::min(underrun_delay_ms_ + frame_duration_ms_, JITTER_BUFFER_MAX_DELAY_MS);
+                last_adjust_time_us_ = now_us;
+                if (skipped > 0 && skipped < capacity) {
+                    statistics_.lost += skipped;
+                }
+            }
+            Restart(sequence, arrival_us);
+        }
+
+        int32_t offset = sequence - next_sequence_;
+        if (offset < 0 && state_ == kStateBuffering && int32_t(last_sequence_ - sequence) < capacity) {
+            /* Reordered before playout started, start from the earlier packet */
+            next_sequence_ = sequence;
+            offset = 0;
+        }
+        if (offset < 0) {
+            statistics_.late++;
+            packet.reset();
+            return true;
+        }
+        if (offset >= capacity || (offset + 1) * frame_duration_ms_ > max_duration_ms_) {
+            if (count_ > 0) {
+                return false;
+            }
+            Restart(sequence, arrival_us);
+        }
+
+        auto& slot = slots_[sequence % capacity];
+        if (slot) {
+            statistics_.duplicate++;
+            packet.reset();
+            return true;
+        }
+
+        if (packet->has_sequence) {
+            UpdateJitter(sequence, arrival_us, now_us);
+        }
+        packet->sequence = sequence;
+        slot = std::move(packet);
+        count_++;
+        if (int32_t(sequence - last_sequence_) > 0) {
+            last_sequence_ = sequence;
+        } else if (sequence != last_sequence_) {
+            statistics_.reordered++;
+        }
+        statistics_.received++;
+        consumer = consumer_task_;
+    }
+
+    if (consumer != nullptr) {
+        xTaskNotifyGive(consumer);
+    }
+    return true;
+}
+
+JitterBufferResult JitterBuffer::Pop(AudioStreamPacketPtr& packet, int& wait_ms) {
+    int64_t now_us = esp_timer_get_time();
+    TaskHandle_t producer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == 0) {
+            if (state_ == kStatePlaying) {
+                state_ = kStateBuffering;
+                drained_time_us_ = now_us;
+            }
+            return kJitterBufferEmpty;
+        }
+
+        if (state_ == kStateBuffering) {
+            int target_ms = GetTargetDelayMs();
+            int target_frames = 1 + (target_ms + frame_duration_ms_ - 1) / frame_duration_ms_;
+            int waited_ms = (now_us - buffering_since_us_) / 1000;
+            if (int(count_) < target_frames && waited_ms < target_ms) {
+                wait_ms = target_ms - waited_ms;
+                return kJitterBufferBuffering;
+            }
+            state_ = kStatePlaying;
+        }
+
+        /* Hold a gap for the reorder window, only at its first frame so a burst loss is not delayed further */
+        if (!slots_[next_sequence_ % slots_.size()] && conceal_run_ == 0 && reorder_window_ms_ > 0) {
+            if (gap_since_us_ == 0) {
+                gap_since_us_ = now_us;
+            }
+            int waited_ms = (now_us - gap_since_us_) / 1000;
+            if (waited_ms < reorder_window_ms_) {
+                wait_ms = reorder_window_ms_ - waited_ms;
+                return kJitterBufferBuffering;
+            }
+        }
+        gap_since_us_ = 0;
+
+        if (!slots_[next_sequence_ % slots_.size()] && conceal_run_ < JITTER_BUFFER_MAX_CONCEAL_FRAMES) {
+            next_sequence_++;
+            conceal_run_++;
+            statistics_.lost++;
+            statistics_.concealed++;
+            return kJitterBufferLost;
+        }
+
+        /* Skip the rest of a long gap */
+        while (!slots_[next_sequence_ % slots_.size()]) {
+            next_sequence_++;
+            statistics_.lost++;
+        }
+        packet = std::move(slots_[next_sequence_ % slots_.size()]);
+        next_sequence_++;
+        count_--;
+        conceal_run_ = 0;
+        producer = producer_task_;
+    }
+
+    if (producer != nullptr) {
+        xTaskNotifyGive(producer);
+    }
+    return kJitterBufferPacket;
+}
+
+void JitterBuffer::Clear() {
+    TaskHandle_t producer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& slot : slots_) {
+            slot.reset();
+        }
+        count_ = 0;
+        state_ = kStateIdle;
+        drained_time_us_ = 0;
+        gap_since_us_ = 0;
+        conceal_run_ = 0;
+        jitter_us_ = 0;
+        underrun_delay_ms_ = 0;
+        producer = producer_task_;
+    }
+
+    if (producer != nullptr) {
+        xTaskNotifyGive(producer);
+    }
+}
+
+JitterBufferStatistics JitterBuffer::GetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    JitterBufferStatistics statistics = statistics_;
+    statistics.jitter_ms = jitter_us_ / 1000;
+    statistics.target_delay_ms = GetTargetDelayMs();
+    return statistics;
+}
+
+void JitterBuffer::SetProducerTask(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    producer_task_ = task;
+}
+
+void JitterBuffer::SetConsumerTask(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    consumer_task_ = task;
+}
+
+void JitterBuffer::Restart(uint32_t sequence, int64_t now_us) {
+    state_ = kStateBuffering;
+    next_sequence_ = sequence;
+    last_sequence_ = sequence;
+    base_sequence_ = sequence;
+    min_transit_us_ = now_us;
+    buffering_since_us_ = now_us;
+    drained_time_us_ = 0;
+    gap_since_us_ = 0;
+    conceal_run_ = 0;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t arrival_us, int64_t now_us) {
+    // Transit time relative to the earliest packet of the stream, ignoring the sender's clock offset
+    int64_t transit_us = arrival_us - int64_t(int32_t(sequence - base_sequence_)) * frame_duration_ms_ * 1000;
+    if (transit_us < min_transit_us_) {
+        min_transit_us_ = transit_us;
+    }
+    int64_t lateness_us = transit_us - min_transit_us_;
+    // React fast to late packets, relax slowly
+    jitter_us_ += (lateness_us - jitter_us_) / (lateness_us > jitter_us_ ? 4 : 64);
+
+    if (underrun_delay_ms_ > 0 && now_us - last_adjust_time_us_ > JITTER_BUFFER_DECAY_MS * 1000LL) {
+        underrun_delay_ms_ = std::max(underrun_delay_ms_ - frame_duration_ms_, 0);
+        last_adjust_time_us_ = now_us;
+    }
+}
+
+int JitterBuffer::GetTargetDelayMs() const {
+    int target_ms = 2 * jitter_us_ / 1000 + underrun_delay_ms_;
+    return std::clamp(target_ms, JITTER_BUFFER_MIN_DELAY_MS, JITTER_BUFFER_MAX_DELAY_MS);
+}
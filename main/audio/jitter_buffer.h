@@ -0,0 +1,120 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "protocol.h"
+
+/*
+ * Adaptive jitter buffer in front of the Opus decoder.
+ *
+ * Packets are ordered by AudioStreamPacket::sequence. Packets without a sequence number
+ * (websocket) are numbered in arrival order. The decoder pulls one frame at a
+ * time, and gets either the next packet, or kJitterBufferLost if that packet is missing
+ * while later ones have arrived, so it can conceal the gap with Opus PLC. A missing packet is
+ * awaited for up to the reorder window first, the wait ends early when it arrives.
+ *
+ * After the buffer runs dry, playout restarts once the target delay is buffered, or once the
+ * first packet has waited that long. The target delay follows the measured arrival jitter,
+ * and grows after every underrun in the middle of a stream. Both are only measured on streams
+ * with sender sequence numbers: without them a pause between two TTS sentences can't be told
+ * from a late packet. Clear() forgets them, it is called between sessions.
+ */
+
+#define JITTER_BUFFER_MIN_DELAY_MS 0
+#define JITTER_BUFFER_MAX_DELAY_MS 600
+// Longer gaps are skipped instead of concealed
+#define JITTER_BUFFER_MAX_CONCEAL_FRAMES 3
+// A stream that resumes within this time after running dry counts as an underrun
+#define JITTER_BUFFER_UNDERRUN_GAP_MS 1000
+// The extra delay added by underruns is reduced by one frame after this time without underrun
+#define JITTER_BUFFER_DECAY_MS 30000
+
+enum JitterBufferResult {
+    kJitterBufferEmpty,     // Nothing to play, wait for the next push
+    kJitterBufferBuffering, // Waiting for the target delay or a reordered packet, retry after wait_ms
+    kJitterBufferPacket,    // The next packet is returned
+    kJitterBufferLost,      // The next packet is missing and should be concealed
+};
+
+struct JitterBufferStatistics {
+    uint32_t received = 0;
+    uint32_t reordered = 0;
+    uint32_t late = 0;
+    uint32_t duplicate = 0;
+    uint32_t lost = 0;
+    uint32_t concealed = 0;
+    uint32_t underruns = 0;
+    int jitter_ms = 0;
+    int target_delay_ms = 0;
+};
+
+class JitterBuffer {
+public:
+    // Holds up to capacity packets, and no more than max_duration_ms of audio
+    JitterBuffer(size_t capacity, int max_duration_ms, int reorder_window_ms = 0);
+
+    JitterBuffer(const JitterBuffer&) = delete;
+    JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+    size_t capacity() const { return slots_.size(); }
+    size_t Size();
+    bool Empty() { return Size() == 0; }
+
+    // May be called from any task. Returns false if the packet doesn't fit, the packet is kept then.
+    // Late and duplicate packets are consumed and counted.
+    bool Push(AudioStreamPacketPtr&& packet);
+    // Consumer side. wait_ms is set for kJitterBufferBuffering.
+    JitterBufferResult Pop(AudioStreamPacketPtr& packet, int& wait_ms);
+    void Clear();
+
+    JitterBufferStatistics GetStatistics();
+
+    // Tasks notified after every push (consumer) and every pop (producer), like SpscQueue
+    void SetProducerTask(TaskHandle_t task);
+    void SetConsumerTask(TaskHandle_t task);
+
+private:
+    enum State {
+        kStateIdle,
+        kStateBuffering,
+        kStatePlaying,
+    };
+
+    std::mutex mutex_;
+    std::vector<AudioStreamPacketPtr> slots_;
+    int max_duration_ms_;
+    int reorder_window_ms_;
+    size_t count_ = 0;
+    State state_ = kStateIdle;
+    uint32_t next_sequence_ = 0;
+    uint32_t last_sequence_ = 0;
+    int conceal_run_ = 0;
+    int frame_duration_ms_ = 60;
+    int64_t buffering_since_us_ = 0;
+    int64_t drained_time_us_ = 0;
+    int64_t gap_since_us_ = 0;
+
+    // Target delay controller
+    uint32_t base_sequence_ = 0;
+    int64_t min_transit_us_ = 0;
+    int64_t jitter_us_ = 0;
+    int underrun_delay_ms_ = 0;
+    int64_t last_adjust_time_us_ = 0;
+
+    JitterBufferStatistics statistics_;
+    TaskHandle_t producer_task_ = nullptr;
+    TaskHandle_t consumer_task_ = nullptr;
+
+    void Restart(uint32_t sequence, int64_t now_us);
+    void UpdateJitter(uint32_t sequence, int64_t arrival_us, int64_t now_us);
+    int GetTargetDelayMs() const;
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,84 @@
+#include "pcm_ring_buffer.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "PcmRingBuffer"
+
+PcmRingBuffer::PcmRingBuffer(size_t capacity_samples) {
+    size_t bytes = capacity_samples * sizeof(int16_t);
+    buffer_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (buffer_ == nullptr) {
+        buffer_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    if (buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes", bytes);
+        return;
+    }
+    capacity_ = capacity_samples;
+}
+
+PcmRingBuffer::~PcmRingBuffer() {
+    if (buffer_ != nullptr) {
+        heap_caps_free(buffer_);
+    }
+}
+
+void PcmRingBuffer::Write(const int16_t* data, size_t samples) {
+    if (capacity_ == 0) {
+        return;
+    }
+    /* Only the newest capacity_ samples survive */
+    if (samples > capacity_) {
+        data += samples - capacity_;
+        samples = capacity_;
+    }
+    size_t first = capacity_ - head_;
+    if (first > samples) {
+        first = samples;
+    }
+    memcpy(buffer_ + head_, data, first * sizeof(int16_t));
+    memcpy(buffer_, data + first, (samples - first) * sizeof(int16_t));
+    head_ = (head_ + samples) % capacity_;
+    size_ = size_ + samples > capacity_ ? capacity_ : size_ + samples;
+}
+
+void PcmRingBuffer::Clear() {
+    head_ = 0;
+    size_ = 0;
+}
+
+int PcmRingBuffer::GetSpans(PcmSpan spans[2]) const {
+    if (size_ == 0) {
+        return 0;
+    }
+    size_t tail = (head_ + capacity_ - size_) % capacity_;
+    if (tail + size_ <= capacity_) {
+        spans[0] = {buffer_ + tail, size_};
+        return 1;
+    }
+    spans[0] = {buffer_ + tail, capacity_ - tail};
+    spans[1] = {buffer_, size_ - (capacity_ - tail)};
+    return 2;
+}
+
+int PcmRingBuffer::ForEachFrame(size_t frame_samples, int16_t* scratch, std::function<void(const int16_t* frame)> handler) const {
+    if (frame_samples == 0 || size_ < frame_samples) {
+        return 0;
+    }
+    int frames = size_ / frame_samples;
+    size_t position = (head_ + capacity_ - frames * frame_samples) % capacity_;
+    for (int i = 0; i < frames; i++) {
+        if (position + frame_samples <= capacity_) {
+            handler(buffer_ + position);
+        } else {
+            size_t first = capacity_ - position;
+            memcpy(scratch, buffer_ + position, first * sizeof(int16_t));
+            memcpy(scratch + first, buffer_, (frame_samples - first) * sizeof(int16_t));
+            handler(scratch);
+        }
+        position = (position + frame_samples) % capacity_;
+    }
+    return frames;
+}
@@ -0,0 +1,50 @@
+#ifndef PCM_RING_BUFFER_H
+#define PCM_RING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/*
+ * Fixed ring of the most recent PCM samples, e.g. the pre-roll audio of the wake word.
+ *
+ * The storage is allocated once, in PSRAM if there is any. Write() overwrites the oldest
+ * samples when the ring is full, so a continuous stream never allocates. GetSpans() returns
+ * the buffered samples in place, oldest first, as up to two contiguous spans.
+ *
+ * Not thread safe, readers must not run while the writer is active.
+ */
+
+struct PcmSpan {
+    const int16_t* data = nullptr;
+    size_t samples = 0;
+};
+
+class PcmRingBuffer {
+public:
+    explicit PcmRingBuffer(size_t capacity_samples);
+    ~PcmRingBuffer();
+
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+
+    inline size_t size() const { return size_; }
+    inline size_t capacity() const { return capacity_; }
+
+    void Write(const int16_t* data, size_t samples);
+    void Clear();
+    // Returns the number of spans, 0 if the ring is empty
+    int GetSpans(PcmSpan spans[2]) const;
+    // Calls handler with every complete frame, oldest first. The oldest samples that don't fill a
+    // frame are skipped, so the newest ones are included. Frames are passed in place, only one that
+    // wraps around the end of the ring is copied to scratch (frame_samples). Returns the frame count.
+    int ForEachFrame(size_t frame_samples, int16_t* scratch, std::function<void(const int16_t* frame)> handler) const;
+
+private:
+    int16_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    size_t head_ = 0;   // Next sample to write
+    size_t size_ = 0;
+};
+
+#endif // PCM_RING_BUFFER_H
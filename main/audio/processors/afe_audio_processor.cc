@@ -5,17 +5,28 @@
 
 #define TAG "AfeAudioProcessor"
 
-AfeAudioProcessor::AfeAudioProcessor()
-    : afe_data_(nullptr) {
+AfeAudioProcessor::AfeAudioProcessor(std::shared_ptr<AfeFrontEnd> front_end)
+    : front_end_(front_end), afe_data_(nullptr) {
     event_group_ = xEventGroupCreate();
 }
 
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
-
-    // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
+    output_assembler_.SetFrameSamples(frame_samples_);
+
+    if (front_end_) {
+        front_end_->OnFetch(kAfeConsumerProcessor, [this](afe_fetch_result_t* res) {
+            OnFetchResult(res);
+        });
+        if (front_end_->Initialize(codec_)) {
+            return;
+        }
+        // The voice processing does not need the SR models, it can still run on its own AFE
+        ESP_LOGE(TAG, "Failed to initialize the shared AFE, creating a separate one");
+        front_end_->OnFetch(kAfeConsumerProcessor, nullptr);
+        front_end_.reset();
+    }
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -78,13 +89,25 @@ AfeAudioProcessor::~AfeAudioProcessor() {
 }
 
 size_t AfeAudioProcessor::GetFeedSize() {
+    if (front_end_) {
+        return front_end_->GetFeedSize();
+    }
     if (afe_data_ == nullptr) {
         return 0;
     }
     return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    // A fetch may still be running, the new size is applied by the next one
+    pending_frame_samples_.store(frame_duration_ms * 16000 / 1000);
+}
+
 void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
+    if (front_end_) {
+        front_end_->Feed(data.data());
+        return;
+    }
     if (afe_data_ == nullptr) {
         return;
     }
@@ -92,10 +115,18 @@ void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
 }
 
 void AfeAudioProcessor::Start() {
+    if (front_end_) {
+        front_end_->StartConsumer(kAfeConsumerProcessor);
+        return;
+    }
     xEventGroupSetBits(event_group_, PROCESSOR_RUNNING);
 }
 
 void AfeAudioProcessor::Stop() {
+    if (front_end_) {
+        front_end_->StopConsumer(kAfeConsumerProcessor);
+        return;
+    }
     xEventGroupClearBits(event_group_, PROCESSOR_RUNNING);
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
@@ -103,10 +134,13 @@ void AfeAudioProcessor::Stop() {
 }
 
 bool AfeAudioProcessor::IsRunning() {
+    if (front_end_) {
+        return front_end_->IsConsumerRunning(kAfeConsumerProcessor);
+    }
     return xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING;
 }
 
-void AfeAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void AfeAudioProcessor::OnOutput(std::function<void(const int16_t* data, size_t samples)> callback) {
     output_callback_ = callback;
 }
 
@@ -134,41 +168,46 @@ void AfeAudioProcessor::AudioProcessorTask() {
             continue;
         }
 
-        // VAD state change
-        if (vad_state_change_callback_) {
-            if (res->vad_state == VAD_SPEECH && !is_speaking_) {
-                is_speaking_ = true;
-                vad_state_change_callback_(true);
-            } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
-                is_speaking_ = false;
-                vad_state_change_callback_(false);
-            }
-        }
+        OnFetchResult(res);
+    }
+}
 
-        if (output_callback_) {
-            size_t samples = res->data_size / sizeof(int16_t);
-            
-            // Add data to buffer
-            output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
-            
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
-            }
+void AfeAudioProcessor::OnFetchResult(afe_fetch_result_t* res) {
+    int frame_samples = pending_frame_samples_.exchange(0);
+    if (frame_samples != 0) {
+        frame_samples_ = frame_samples;
+        output_assembler_.SetFrameSamples(frame_samples_);
+    }
+
+    // VAD state change
+    if (vad_state_change_callback_) {
+        if (res->vad_state == VAD_SPEECH && !is_speaking_) {
+            is_speaking_ = true;
+            vad_state_change_callback_(true);
+        } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
+            is_speaking_ = false;
+            vad_state_change_callback_(false);
         }
     }
+
+    if (output_callback_) {
+        // Frames are cut straight out of the fetch result when they fit, otherwise assembled once
+        size_t samples = res->data_size / sizeof(int16_t);
+        output_assembler_.Push(res->data, samples, output_callback_);
+    }
 }
 
 void AfeAudioProcessor::EnableDeviceAec(bool enable) {
+    if (front_end_) {
+#if CONFIG_USE_DEVICE_AEC
+        front_end_->EnableDeviceAec(enable);
+#else
+        if (enable) {
+            ESP_LOGE(TAG, "Device AEC is not supported");
+        }
+#endif
+        return;
+    }
     if (enable) {
 #if CONFIG_USE_DEVICE_AEC
         afe_iface_->disable_vad(afe_data_);
@@ -9,37 +9,47 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "frame_assembler.h"
+#include "afe_front_end.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
-    AfeAudioProcessor();
+    // With a front end, the processor is a consumer of the shared AFE instead of creating its own
+    explicit AfeAudioProcessor(std::shared_ptr<AfeFrontEnd> front_end = nullptr);
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms) override;
+    void SetFrameDuration(int frame_duration_ms) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
-    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    void OnOutput(std::function<void(const int16_t* data, size_t samples)> callback) override;
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
 
 private:
     EventGroupHandle_t event_group_ = nullptr;
+    std::shared_ptr<AfeFrontEnd> front_end_;
     esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
-    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::function<void(const int16_t* data, size_t samples)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
     int frame_samples_ = 0;
+    // Set by SetFrameDuration, taken over by the fetch task that owns the assembler
+    std::atomic<int> pending_frame_samples_{0};
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    FrameAssembler output_assembler_;
 
     void AudioProcessorTask();
+    void OnFetchResult(afe_fetch_result_t* res);
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "afe_front_end.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_nsn_models.h>
+#include <string>
+
+#define TAG "AfeFrontEnd"
+
+#define AFE_STAGE_WAKENET   0x01
+#define AFE_STAGE_AEC       0x02
+#define AFE_STAGE_NS        0x04
+#define AFE_STAGE_VAD       0x08
+
+#define AFE_CONSUMER_BIT(consumer) (1 << (consumer))
+#define AFE_ALL_CONSUMERS ((1 << kAfeConsumerCount) - 1)
+
+AfeFrontEnd::AfeFrontEnd() {
+    event_group_ = xEventGroupCreate();
+}
+
+AfeFrontEnd::~AfeFrontEnd() {
+    if (afe_data_ != nullptr) {
+        afe_iface_->destroy(afe_data_);
+    }
+    if (models_ != nullptr) {
+        esp_srmodel_deinit(models_);
+    }
+    vEventGroupDelete(event_group_);
+}
+
+bool AfeFrontEnd::Initialize(AudioCodec* codec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (initialized_) {
+        return init_result_;
+    }
+    initialized_ = true;
+    codec_ = codec;
+
+    int64_t start_time = esp_timer_get_time();
+    size_t free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    size_t free_spiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
+    models_ = esp_srmodel_init("model");
+    if (models_ == nullptr || models_->num == -1) {
+        ESP_LOGE(TAG, "Failed to initialize models");
+        return false;
+    }
+
+    int ref_num = codec_->input_reference() ? 1 : 0;
+    std::string input_format;
+    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
+        input_format.push_back('M');
+    }
+    for (int i = 0; i < ref_num; i++) {
+        input_format.push_back('R');
+    }
+
+    // Only the SR pipeline can run WakeNet, the other stages are added to it. Its AEC is tuned for
+    // recognition rather than voice calls, the uplink gets that one too (see afe_front_end.h)
+    afe_config_t* afe_config = afe_config_init(input_format.c_str(), models_, AFE_TYPE_SR, AFE_MODE_HIGH_PERF);
+    afe_config->aec_init = codec_->input_reference();
+    afe_config->aec_mode = AEC_MODE_SR_HIGH_PERF;
+    afe_config->vad_init = true;
+    afe_config->vad_mode = VAD_MODE_0;
+    afe_config->vad_min_noise_ms = 100;
+    char* vad_model_name = esp_srmodel_filter(models_, ESP_VADN_PREFIX, NULL);
+    if (vad_model_name != nullptr) {
+        afe_config->vad_model_name = vad_model_name;
+    }
+    char* ns_model_name = esp_srmodel_filter(models_, ESP_NSNET_PREFIX, NULL);
+    if (ns_model_name != nullptr) {
+        afe_config->ns_init = true;
+        afe_config->ns_model_name = ns_model_name;
+        afe_config->afe_ns_mode = AFE_NS_MODE_NET;
+    } else {
+        afe_config->ns_init = false;
+    }
+    afe_config->afe_perferred_core = 1;
+    afe_config->afe_perferred_priority = 1;
+    afe_config->agc_init = false;
+    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+
+    afe_iface_ = esp_afe_handle_from_config(afe_config);
+    afe_data_ = afe_iface_->create_from_config(afe_config);
+    if (afe_data_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create AFE");
+        return false;
+    }
+
+    available_stages_ = (afe_config->wakenet_init ? AFE_STAGE_WAKENET : 0) |
+        (afe_config->aec_init ? AFE_STAGE_AEC : 0) |
+        (afe_config->ns_init ? AFE_STAGE_NS : 0) |
+        (afe_config->vad_init ? AFE_STAGE_VAD : 0);
+    // The AFE starts with all of them enabled, nothing runs until a consumer starts
+    enabled_stages_ = available_stages_;
+    UpdateStages();
+
+    ESP_LOGI(TAG, "Shared AFE created in %d ms, stages 0x%lx, internal heap %u bytes, PSRAM %u bytes",
+        int((esp_timer_get_time() - start_time) / 1000), available_stages_,
+        free_internal - heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        free_spiram - heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+
+    xTaskCreate([](void* arg) {
+        auto this_ = (AfeFrontEnd*)arg;
+        this_->FetchTask();
+        vTaskDelete(NULL);
+    }, "audio_afe", 4096, this, 3, NULL);
+
+    init_result_ = true;
+    return true;
+}
+
+void AfeFrontEnd::Feed(const int16_t* data) {
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    afe_iface_->feed(afe_data_, data);
+}
+
+size_t AfeFrontEnd::GetFeedSize() {
+    if (afe_data_ == nullptr) {
+        return 0;
+    }
+    return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
+}
+
+void AfeFrontEnd::OnFetch(AfeConsumer consumer, std::function<void(afe_fetch_result_t* result)> callback) {
+    callbacks_[consumer] = callback;
+}
+
+void AfeFrontEnd::StartConsumer(AfeConsumer consumer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    xEventGroupSetBits(event_group_, AFE_CONSUMER_BIT(consumer));
+    UpdateStages();
+}
+
+void AfeFrontEnd::StopConsumer(AfeConsumer consumer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    xEventGroupClearBits(event_group_, AFE_CONSUMER_BIT(consumer));
+    UpdateStages();
+    // The other consumer keeps the buffered audio
+    if (afe_data_ != nullptr && (xEventGroupGetBits(event_group_) & AFE_ALL_CONSUMERS) == 0) {
+        afe_iface_->reset_buffer(afe_data_);
+    }
+}
+
+bool AfeFrontEnd::IsConsumerRunning(AfeConsumer consumer) {
+    return xEventGroupGetBits(event_group_) & AFE_CONSUMER_BIT(consumer);
+}
+
+void AfeFrontEnd::EnableDeviceAec(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (enable && afe_data_ != nullptr && (available_stages_ & AFE_STAGE_AEC) == 0) {
+        ESP_LOGE(TAG, "Device AEC is not supported, there is no reference channel");
+    }
+    device_aec_ = enable;
+    UpdateStages();
+}
+
+void AfeFrontEnd::UpdateStages() {
+    if (afe_data_ == nullptr) {
+        return;
+    }
+
+    auto bits = xEventGroupGetBits(event_group_);
+    bool wake_word = bits & AFE_CONSUMER_BIT(kAfeConsumerWakeWord);
+    bool processor = bits & AFE_CONSUMER_BIT(kAfeConsumerProcessor);
+
+    // Same as the separate instances: the processor cancels echo only with device AEC, so the uplink
+    // doesn't change with the wake word running next to it. WakeNet alone uses the reference channel.
+    uint32_t stages = 0;
+    if (wake_word) {
+        stages |= AFE_STAGE_WAKENET;
+    }
+    if (processor ? device_aec_ : wake_word) {
+        stages |= AFE_STAGE_AEC;
+    }
+    if (processor) {
+        stages |= AFE_STAGE_NS;
+    }
+    if (processor && !device_aec_) {
+        stages |= AFE_STAGE_VAD;
+    }
+    stages &= available_stages_;
+
+    uint32_t changed = stages ^ enabled_stages_;
+    if (changed & AFE_STAGE_WAKENET) {
+        if (stages & AFE_STAGE_WAKENET) {
+            afe_iface_->enable_wakenet(afe_data_);
+        } else {
+            afe_iface_->disable_wakenet(afe_data_);
+        }
+    }
+    if (changed & AFE_STAGE_AEC) {
+        if (stages & AFE_STAGE_AEC) {
+            afe_iface_->enable_aec(afe_data_);
+        } else {
+            afe_iface_->disable_aec(afe_data_);
+        }
+    }
+    if (changed & AFE_STAGE_NS) {
+        if (stages & AFE_STAGE_NS) {
+            afe_iface_->enable_ns(afe_data_);
+        } else {
+            afe_iface_->disable_ns(afe_data_);
+        }
+    }
+    if (changed & AFE_STAGE_VAD) {
+        if (stages & AFE_STAGE_VAD) {
+            afe_iface_->enable_vad(afe_data_);
+        } else {
+            afe_iface_->disable_vad(afe_data_);
+        }
+    }
+    if (changed != 0) {
+        ESP_LOGD(TAG, "AFE stages: 0x%lx -> 0x%lx", enabled_stages_, stages);
+    }
+    enabled_stages_ = stages;
+}
+
+void AfeFrontEnd::FetchTask() {
+    auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
+    auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
+    ESP_LOGI(TAG, "Shared AFE task started, feed size: %d fetch size: %d",
+        feed_size, fetch_size);
+
+    while (true) {
+        xEventGroupWaitBits(event_group_, AFE_ALL_CONSUMERS, pdFALSE, pdFALSE, portMAX_DELAY);
+
+        auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
+        if (res == nullptr || res->ret_value == ESP_FAIL) {
+            if (res != nullptr) {
+                ESP_LOGI(TAG, "Error code: %d", res->ret_value);
+            }
+            continue;
+        }
+
+        // A callback may stop a consumer, so the bits are checked again before each one
+        for (int i = 0; i < kAfeConsumerCount; i++) {
+            if ((xEventGroupGetBits(event_group_) & AFE_CONSUMER_BIT(i)) && callbacks_[i]) {
+                callbacks_[i](res);
+            }
+        }
+    }
+}
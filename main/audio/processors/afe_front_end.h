@@ -0,0 +1,75 @@
+#ifndef AFE_FRONT_END_H
+#define AFE_FRONT_END_H
+
+#include <esp_afe_sr_models.h>
+#include <model_path.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+
+#include <mutex>
+#include <functional>
+
+#include "audio_codec.h"
+
+/*
+ * One AFE instance shared by AfeWakeWord and AfeAudioProcessor (CONFIG_USE_SHARED_AFE).
+ *
+ * Each of them used to create its own AFE with its own fetch task and ring buffers. Here they are
+ * consumers of one pipeline: the fetch task hands every result to the consumers that are running,
+ * and the stages follow them at runtime. WakeNet runs while the wake word consumer runs, NS and VAD
+ * while the processor runs. AEC follows device AEC while the processor runs, as the separate
+ * processor did, otherwise it runs for the wake word if there is a reference channel.
+ * Switching between idle and listening only flips stages, the pipeline stays warm.
+ *
+ * WakeNet only runs in an AFE_TYPE_SR pipeline, so the shared AFE is of that type, with the SR
+ * tuning of AEC (AEC_MODE_SR_HIGH_PERF). The separate AfeAudioProcessor uses AFE_TYPE_VC with
+ * AEC_MODE_VOIP_HIGH_PERF, so sharing changes the echo cancellation of the uplink voice.
+ */
+
+enum AfeConsumer {
+    kAfeConsumerWakeWord = 0,
+    kAfeConsumerProcessor,
+    kAfeConsumerCount
+};
+
+class AfeFrontEnd {
+public:
+    AfeFrontEnd();
+    ~AfeFrontEnd();
+
+    // Creates the AFE on the first call, later calls return the result of the first
+    bool Initialize(AudioCodec* codec);
+    inline srmodel_list_t* models() const { return models_; }
+
+    void Feed(const int16_t* data);
+    size_t GetFeedSize();
+
+    // The callback runs on the fetch task, set it before the consumer is started
+    void OnFetch(AfeConsumer consumer, std::function<void(afe_fetch_result_t* result)> callback);
+    void StartConsumer(AfeConsumer consumer);
+    void StopConsumer(AfeConsumer consumer);
+    bool IsConsumerRunning(AfeConsumer consumer);
+    void EnableDeviceAec(bool enable);
+
+private:
+    std::mutex mutex_;
+    bool initialized_ = false;
+    bool init_result_ = false;
+    srmodel_list_t* models_ = nullptr;
+    esp_afe_sr_iface_t* afe_iface_ = nullptr;
+    esp_afe_sr_data_t* afe_data_ = nullptr;
+    EventGroupHandle_t event_group_ = nullptr;
+    std::function<void(afe_fetch_result_t* result)> callbacks_[kAfeConsumerCount];
+    AudioCodec* codec_ = nullptr;
+
+    // Stages the AFE was created with, and the ones enabled now
+    uint32_t available_stages_ = 0;
+    uint32_t enabled_stages_ = 0;
+    bool device_aec_ = false;
+
+    void UpdateStages();
+    void FetchTask();
+};
+
+#endif
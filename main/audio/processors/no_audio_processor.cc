@@ -6,6 +6,12 @@
 void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    assembler_.SetFrameSamples(frame_samples_);
+}
+
+void NoAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    // The assembler belongs to the input task, it picks up the new size in Feed
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
 }
 
 void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
@@ -13,21 +19,13 @@ void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
         return;
     }
 
-    if (data.size() != frame_samples_) {
-        ESP_LOGE(TAG, "Feed data size is not equal to frame size, feed size: %u, frame size: %u", data.size(), frame_samples_);
-        return;
+    size_t frame_samples = frame_samples_;
+    if (assembler_.frame_samples() != frame_samples) {
+        assembler_.SetFrameSamples(frame_samples);
     }
 
-    if (codec_->input_channels() == 2) {
-        // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
-        }
-        output_callback_(std::move(mono_data));
-    } else {
-        output_callback_(std::move(data));
-    }
+    // The left channel of stereo input is taken while the frame is assembled
+    assembler_.Push(data.data(), data.size(), output_callback_, codec_->input_channels());
 }
 
 void NoAudioProcessor::Start() {
@@ -42,7 +40,7 @@ bool NoAudioProcessor::IsRunning() {
     return is_running_;
 }
 
-void NoAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void NoAudioProcessor::OnOutput(std::function<void(const int16_t* data, size_t samples)> callback) {
     output_callback_ = callback;
 }
 
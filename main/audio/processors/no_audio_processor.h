@@ -3,9 +3,11 @@
 
 #include <vector>
 #include <functional>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "frame_assembler.h"
 
 class NoAudioProcessor : public AudioProcessor {
 public:
@@ -13,21 +15,23 @@ public:
     ~NoAudioProcessor() = default;
 
     void Initialize(AudioCodec* codec, int frame_duration_ms) override;
+    void SetFrameDuration(int frame_duration_ms) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
-    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    void OnOutput(std::function<void(const int16_t* data, size_t samples)> callback) override;
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
 
 private:
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
-    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::atomic<int> frame_samples_{0};
+    std::function<void(const int16_t* data, size_t samples)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     bool is_running_ = false;
+    FrameAssembler assembler_;
 };
 
 #endif 
\ No newline at end of file
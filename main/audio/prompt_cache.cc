@@ -0,0 +1,115 @@
+#include "prompt_cache.h"
+#include "sound_playback.h"
+#include "audio_resampler.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <opus_decoder.h>
+
+#define TAG "PromptCache"
+
+#define PROMPT_SAMPLE_RATE 16000
+#define PROMPT_FRAME_DURATION_MS 60
+
+PromptCache::PromptCache(size_t capacity_bytes) : capacity_bytes_(capacity_bytes) {
+}
+
+PromptCache::~PromptCache() {
+    Clear();
+}
+
+bool PromptCache::Add(std::string_view sound, int sample_rate) {
+    /* Size the buffer for the longest output, the frames are counted first */
+    size_t frames = 0;
+    size_t offset = 0;
+    std::string_view frame;
+    while (NextP3Frame(sound, offset, frame)) {
+        frames++;
+    }
+    size_t frame_samples = sample_rate * PROMPT_FRAME_DURATION_MS / 1000;
+    size_t max_samples = frames * frame_samples;
+    size_t size = max_samples * sizeof(int16_t);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : entries_) {
+            if (entry.key == sound.data() && entry.sample_rate == sample_rate) {
+                return true;
+            }
+        }
+        if (frames == 0 || bytes_ + size > capacity_bytes_) {
+            ESP_LOGW(TAG, "Prompt (%u bytes PCM) does not fit, %u/%u bytes used", size, bytes_, capacity_bytes_);
+            return false;
+        }
+    }
+
+    auto pcm = (int16_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (pcm == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes in PSRAM", size);
+        return false;
+    }
+
+    OpusDecoderWrapper decoder(PROMPT_SAMPLE_RATE, 1, PROMPT_FRAME_DURATION_MS);
+    auto resampler = CreateAudioResampler(PROMPT_SAMPLE_RATE, sample_rate);
+    std::vector<uint8_t> payload;
+    std::vector<int16_t> decoded;
+    size_t samples = 0;
+    offset = 0;
+    while (NextP3Frame(sound, offset, frame)) {
+        payload.assign(frame.begin(), frame.end());
+        if (!decoder.Decode(std::move(payload), decoded)) {
+            ESP_LOGE(TAG, "Failed to decode prompt");
+            heap_caps_free(pcm);
+            return false;
+        }
+        size_t output_samples = resampler ? resampler->GetOutputSamples(decoded.size()) : decoded.size();
+        if (samples + output_samples > max_samples) {
+            break;
+        }
+        if (resampler) {
+            resampler->Process(decoded.data(), decoded.size(), pcm + samples);
+        } else {
+            std::copy(decoded.begin(), decoded.end(), pcm + samples);
+        }
+        samples += output_samples;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back({sound.data(), sample_rate, pcm, samples});
+    bytes_ += size;
+    return true;
+}
+
+bool PromptCache::Find(std::string_view sound, int sample_rate, const int16_t*& pcm, size_t& samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) {
+        if (entry.key == sound.data() && entry.sample_rate == sample_rate) {
+            pcm = entry.pcm;
+            samples = entry.samples;
+            hits_++;
+            return true;
+        }
+    }
+    misses_++;
+    return false;
+}
+
+void PromptCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) {
+        heap_caps_free(entry.pcm);
+    }
+    entries_.clear();
+    bytes_ = 0;
+}
+
+PromptCacheStatistics PromptCache::GetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PromptCacheStatistics statistics;
+    statistics.hits = hits_;
+    statistics.misses = misses_;
+    statistics.entries = entries_.size();
+    statistics.bytes = bytes_;
+    statistics.capacity_bytes = capacity_bytes_;
+    return statistics;
+}
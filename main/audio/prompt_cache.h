@@ -0,0 +1,61 @@
+#ifndef PROMPT_CACHE_H
+#define PROMPT_CACHE_H
+
+#include <mutex>
+#include <vector>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Decoded PCM of the short P3 prompts that are played often (clicks, popups, digits),
+ * so they are played without running the Opus decoder.
+ *
+ * The entries are keyed by the address of the embedded sound and the output sample rate,
+ * and stored in PSRAM. The cache is bounded by capacity_bytes and filled by Add(), usually
+ * at boot. Entries are never evicted, the PCM returned by Find() stays valid until Clear().
+ */
+
+struct PromptCacheStatistics {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacity_bytes = 0;
+};
+
+class PromptCache {
+public:
+    explicit PromptCache(size_t capacity_bytes);
+    ~PromptCache();
+
+    PromptCache(const PromptCache&) = delete;
+    PromptCache& operator=(const PromptCache&) = delete;
+
+    // Decodes the P3 sound (16kHz / 60ms frames) to PCM at sample_rate.
+    // Returns false if it does not fit in the remaining capacity or could not be decoded.
+    bool Add(std::string_view sound, int sample_rate);
+    // Counts a hit or a miss
+    bool Find(std::string_view sound, int sample_rate, const int16_t*& pcm, size_t& samples);
+    // Only while no cached sound is playing
+    void Clear();
+
+    PromptCacheStatistics GetStatistics();
+
+private:
+    struct Entry {
+        const char* key;
+        int sample_rate;
+        int16_t* pcm;
+        size_t samples;
+    };
+
+    std::mutex mutex_;
+    std::vector<Entry> entries_;
+    size_t capacity_bytes_;
+    size_t bytes_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+};
+
+#endif // PROMPT_CACHE_H
@@ -0,0 +1,66 @@
+#include "sound_playback.h"
+#include "protocol.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+
+#define TAG "SoundPlayback"
+
+#define SOUND_PLAYBACK_DONE (1 << 0)
+
+bool NextP3Frame(std::string_view data, size_t& offset, std::string_view& frame) {
+    if (offset + sizeof(BinaryProtocol3) > data.size()) {
+        return false;
+    }
+
+    auto p3 = reinterpret_cast<const BinaryProtocol3*>(data.data() + offset);
+    size_t payload_size = ntohs(p3->payload_size);
+    size_t payload_offset = offset + sizeof(BinaryProtocol3);
+    if (payload_offset + payload_size > data.size()) {
+        ESP_LOGW(TAG, "Truncated P3 frame at offset %u", offset);
+        return false;
+    }
+    frame = data.substr(payload_offset, payload_size);
+    offset = payload_offset + payload_size;
+    return true;
+}
+
+SoundPlayback::SoundPlayback(std::string_view data, const int16_t* pcm, size_t pcm_samples)
+    : data_(data), pcm_(pcm), pcm_samples_(pcm_samples) {
+    event_group_ = xEventGroupCreate();
+}
+
+SoundPlayback::~SoundPlayback() {
+    vEventGroupDelete(event_group_);
+}
+
+void SoundPlayback::Cancel() {
+    cancelled_ = true;
+}
+
+bool SoundPlayback::Wait(TickType_t timeout) {
+    auto bits = xEventGroupWaitBits(event_group_, SOUND_PLAYBACK_DONE, pdFALSE, pdTRUE, timeout);
+    return bits & SOUND_PLAYBACK_DONE;
+}
+
+bool SoundPlayback::done() const {
+    return xEventGroupGetBits(event_group_) & SOUND_PLAYBACK_DONE;
+}
+
+bool SoundPlayback::NextFrame(std::string_view& frame) {
+    return !cancelled_ && NextP3Frame(data_, offset_, frame);
+}
+
+bool SoundPlayback::NextPcm(const int16_t*& pcm, size_t& samples, size_t max_samples) {
+    if (cancelled_ || offset_ >= pcm_samples_) {
+        return false;
+    }
+    pcm = pcm_ + offset_;
+    samples = pcm_samples_ - offset_ < max_samples ? pcm_samples_ - offset_ : max_samples;
+    offset_ += samples;
+    return true;
+}
+
+void SoundPlayback::Finish() {
+    xEventGroupSetBits(event_group_, SOUND_PLAYBACK_DONE);
+}
@@ -0,0 +1,59 @@
+#ifndef SOUND_PLAYBACK_H
+#define SOUND_PLAYBACK_H
+
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+/*
+ * Playback of an embedded P3 sound, shared by the caller and the opus decoder task.
+ *
+ * The frames are read by reference from the sound data, which must stay valid until the
+ * playback is done (the embedded sounds are mapped from flash for the lifetime of the app).
+ * A sound found in the prompt cache is played from its decoded PCM instead.
+ * The caller keeps the handle to cancel the playback or to wait for it, or drops it to
+ * play the sound in the background.
+ */
+// Reads the Opus payload of the P3 frame at offset and advances offset, returns false at the end
+bool NextP3Frame(std::string_view data, size_t& offset, std::string_view& frame);
+
+class SoundPlayback {
+public:
+    explicit SoundPlayback(std::string_view data, const int16_t* pcm = nullptr, size_t pcm_samples = 0);
+    ~SoundPlayback();
+
+    SoundPlayback(const SoundPlayback&) = delete;
+    SoundPlayback& operator=(const SoundPlayback&) = delete;
+
+    // Stops the playback after the frame being decoded, the rest of the sound is skipped
+    void Cancel();
+    // Returns true if the sound was played or cancelled within the timeout
+    bool Wait(TickType_t timeout = portMAX_DELAY);
+    bool done() const;
+    bool cancelled() const { return cancelled_; }
+
+    bool cached() const { return pcm_ != nullptr; }
+
+    // Decoder side, returns false once the sound is over or cancelled
+    bool NextFrame(std::string_view& frame);
+    // Same for cached sounds, returns up to max_samples of the decoded PCM
+    bool NextPcm(const int16_t*& pcm, size_t& samples, size_t max_samples);
+    void Finish();
+
+private:
+    std::string_view data_;
+    const int16_t* pcm_;
+    size_t pcm_samples_;
+    size_t offset_ = 0;
+    std::atomic<bool> cancelled_ = false;
+    EventGroupHandle_t event_group_;
+};
+
+using SoundHandle = std::shared_ptr<SoundPlayback>;
+
+#endif // SOUND_PLAYBACK_H
@@ -0,0 +1,110 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/*
+ * Bounded lock-free single-producer / single-consumer ring.
+ *
+ * Push() must only be called by one producer and Pop() by one consumer at a time.
+ * Head and tail are free-running counters, so Size() is safe to call from any task.
+ *
+ * Instead of a shared condition variable, the ring wakes the registered consumer task
+ * after every push and the registered producer task after every pop, using direct
+ * task notifications. Waiters use ulTaskNotifyTake() and re-check the ring afterwards.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots_(capacity), limit_(capacity) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    inline size_t capacity() const { return slots_.size(); }
+    inline size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+    // Lower the usable depth without reallocating, e.g. when frames get shorter. May be called from any task.
+    inline void SetLimit(size_t limit) { limit_.store(limit < capacity() ? limit : capacity(), std::memory_order_relaxed); }
+
+    inline size_t Size() const {
+        // Read head first, the tail can only move forward after that
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        return tail - head;
+    }
+    inline bool Empty() const { return Size() == 0; }
+    inline bool Full() const { return Size() >= limit(); }
+
+    // Producer side. The item is left untouched if the ring is full.
+    bool Push(T&& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (tail - head >= limit()) {
+            return false;
+        }
+        slots_[tail % capacity()] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        Notify(consumer_task_);
+        return true;
+    }
+
+    // Consumer side.
+    bool Pop(T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (clear_requested_.exchange(false, std::memory_order_acq_rel)) {
+            uint32_t until = clear_until_.load(std::memory_order_acquire);
+            while (static_cast<int32_t>(until - head) > 0) {
+                slots_[head % capacity()] = T();
+                head++;
+            }
+            head_.store(head, std::memory_order_release);
+            Notify(producer_task_);
+        }
+
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        item = std::move(slots_[head % capacity()]);
+        head_.store(head + 1, std::memory_order_release);
+        Notify(producer_task_);
+        return true;
+    }
+
+    // May be called from any task. Everything pushed so far is dropped by the consumer
+    // on its next Pop(), items pushed afterwards are kept.
+    void RequestClear() {
+        clear_until_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+        clear_requested_.store(true, std::memory_order_release);
+        Notify(consumer_task_);
+        Notify(producer_task_);
+    }
+
+    inline void SetProducerTask(TaskHandle_t task) { producer_task_.store(task, std::memory_order_release); }
+    inline void SetConsumerTask(TaskHandle_t task) { consumer_task_.store(task, std::memory_order_release); }
+
+private:
+    std::vector<T> slots_;
+    std::atomic<uint32_t> head_ = 0;
+    std::atomic<uint32_t> tail_ = 0;
+    std::atomic<size_t> limit_;
+    std::atomic<uint32_t> clear_until_ = 0;
+    std::atomic<bool> clear_requested_ = false;
+    std::atomic<TaskHandle_t> producer_task_ = nullptr;
+    std::atomic<TaskHandle_t> consumer_task_ = nullptr;
+
+    static inline void Notify(const std::atomic<TaskHandle_t>& task) {
+        TaskHandle_t handle = task.load(std::memory_order_acquire);
+        if (handle != nullptr) {
+            xTaskNotifyGive(handle);
+        }
+    }
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,176 @@
+#include "uplink_encoder.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "UplinkEncoder"
+
+// From the best quality to the lowest bitrate, the default is about what the fixed encoder sent
+static const UplinkEncoderSettings kUplinkLevels[] = {
+    {32000, 5, false},
+    {24000, 3, false},
+    {16000, 0, false},
+    {12000, 0, true},
+    {8000, 0, true},
+    {6000, 0, true},
+};
+#define UPLINK_LEVEL_COUNT int(sizeof(kUplinkLevels) / sizeof(kUplinkLevels[0]))
+#define UPLINK_DEFAULT_LEVEL 2
+
+UplinkOpusEncoder::UplinkOpusEncoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {
+    frame_size_ = sample_rate * duration_ms / 1000;
+
+    int error;
+    encoder_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+        return;
+    }
+    Apply(kUplinkLevels[UPLINK_DEFAULT_LEVEL]);
+}
+
+UplinkOpusEncoder::~UplinkOpusEncoder() {
+    if (encoder_ != nullptr) {
+        opus_encoder_destroy(encoder_);
+    }
+}
+
+void UplinkOpusEncoder::Apply(const UplinkEncoderSettings& settings) {
+    if (encoder_ == nullptr) {
+        return;
+    }
+    if (settings.bitrate != settings_.bitrate) {
+        opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(settings.bitrate));
+    }
+    if (settings.complexity != settings_.complexity) {
+        opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(settings.complexity));
+    }
+    if (settings.dtx != settings_.dtx) {
+        opus_encoder_ctl(encoder_, OPUS_SET_DTX(settings.dtx ? 1 : 0));
+    }
+    settings_ = settings;
+}
+
+bool UplinkOpusEncoder::Encode(const std::vector<int16_t>& pcm, std::vector<uint8_t>& opus, size_t offset) {
+    if (encoder_ == nullptr) {
+        return false;
+    }
+    if (pcm.size() != size_t(frame_size_ * channels_)) {
+        ESP_LOGE(TAG, "Frame size mismatch: %u, expected %d", pcm.size(), frame_size_ * channels_);
+        return false;
+    }
+    return Encode(pcm.data(), opus, offset);
+}
+
+bool UplinkOpusEncoder::Encode(const int16_t* pcm, std::vector<uint8_t>& opus, size_t offset) {
+    if (encoder_ == nullptr) {
+        return false;
+    }
+    // Opus keeps the packet within the buffer, so sizing it to the bitrate keeps pooled buffers small
+    int max_size = UPLINK_MAX_OPUS_PACKET_SIZE;
+    if (settings_.bitrate > 0) {
+        max_size = std::clamp(settings_.bitrate / 8 * duration_ms_ / 1000 * UPLINK_OPUS_PACKET_PEAK_RATIO,
+            64, UPLINK_MAX_OPUS_PACKET_SIZE);
+    }
+    opus.resize(offset + max_size);
+    int ret = opus_encode(encoder_, pcm, frame_size_, opus.data() + offset, max_size);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        opus.resize(offset);
+        return false;
+    }
+    opus.resize(offset + ret);
+    return true;
+}
+
+void UplinkOpusEncoder::ResetState() {
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_RESET_STATE);
+    }
+}
+
+UplinkRateController::UplinkRateController()
+    : level_(UPLINK_DEFAULT_LEVEL), complexity_cap_(kUplinkLevels[UPLINK_DEFAULT_LEVEL].complexity) {
+    stats_.level = level_;
+    stats_.settings = settings();
+}
+
+UplinkEncoderSettings UplinkRateController::settings() const {
+    auto settings = kUplinkLevels[level_];
+    settings.complexity = std::min(settings.complexity, complexity_cap_);
+    return settings;
+}
+
+UplinkRateStatistics UplinkRateController::GetStatistics() const {
+    return stats_;
+}
+
+bool UplinkRateController::OnFrameEncoded(int frame_duration_ms, int64_t encode_time_us, int backlog_ms, uint32_t send_failures) {
+    window_ms_ += frame_duration_ms;
+    window_encode_us_ += encode_time_us;
+    window_backlog_ms_ = std::max(window_backlog_ms_, backlog_ms);
+    window_failures_ += send_failures;
+    stats_.send_failures += send_failures;
+    if (window_ms_ < UPLINK_RATE_WINDOW_MS) {
+        return false;
+    }
+    bool changed = EndWindow();
+    window_ms_ = 0;
+    window_encode_us_ = 0;
+    window_backlog_ms_ = 0;
+    window_failures_ = 0;
+    return changed;
+}
+
+bool UplinkRateController::EndWindow() {
+    auto old_settings = settings();
+    int load = window_encode_us_ * 100 / (window_ms_ * 1000LL);
+    stats_.backlog_ms = window_backlog_ms_;
+    stats_.encode_load = load;
+
+    /* Bitrate and DTX follow the send queue and the failed sends */
+    if (window_failures_ > 0 || window_backlog_ms_ >= UPLINK_BACKLOG_HIGH_MS) {
+        int steps = window_backlog_ms_ >= 2 * UPLINK_BACKLOG_HIGH_MS ? 2 : 1;
+        if (level_ < UPLINK_LEVEL_COUNT - 1) {
+            level_ = std::min(level_ + steps, UPLINK_LEVEL_COUNT - 1);
+            stats_.step_downs++;
+        }
+        clear_windows_ = 0;
+    } else if (window_backlog_ms_ <= UPLINK_BACKLOG_LOW_MS) {
+        if (++clear_windows_ >= UPLINK_RATE_PROBE_WINDOWS && level_ > 0) {
+            level_--;
+            stats_.step_ups++;
+            clear_windows_ = 0;
+        }
+    } else {
+        clear_windows_ = 0;
+    }
+
+    /* The complexity is capped by the CPU time the encoder takes */
+    if (load >= UPLINK_ENCODE_LOAD_HIGH) {
+        if (old_settings.complexity > 0) {
+            complexity_cap_ = old_settings.complexity - 1;
+            stats_.complexity_limits++;
+        }
+        low_load_windows_ = 0;
+    } else if (load <= UPLINK_ENCODE_LOAD_LOW) {
+        if (++low_load_windows_ >= UPLINK_RATE_PROBE_WINDOWS && complexity_cap_ < 10) {
+            complexity_cap_++;
+            low_load_windows_ = 0;
+        }
+    } else {
+        low_load_windows_ = 0;
+    }
+
+    auto new_settings = settings();
+    stats_.level = level_;
+    stats_.settings = new_settings;
+    if (new_settings.bitrate == old_settings.bitrate && new_settings.complexity == old_settings.complexity &&
+        new_settings.dtx == old_settings.dtx) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Uplink %d bps, complexity %d, dtx %d (backlog %d ms, %lu failed sends, encode load %d%%)",
+        new_settings.bitrate, new_settings.complexity, new_settings.dtx, window_backlog_ms_, window_failures_, load);
+    return true;
+}
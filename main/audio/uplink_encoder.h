@@ -0,0 +1,107 @@
+#ifndef UPLINK_ENCODER_H
+#define UPLINK_ENCODER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <opus.h>
+
+/*
+ * Opus encoder of the uplink, and the controller that adapts its settings to the link.
+ *
+ * OpusEncoderWrapper has no bitrate control, so the uplink uses libopus directly. The wake
+ * word encoders use it too, with the default settings, to encode their pre-roll in place.
+ *
+ * UplinkRateController is fed once per encoded frame with the send queue depth, the
+ * failed sends and the encode time. Once per UPLINK_RATE_WINDOW_MS of audio it moves
+ * along a ladder of settings: one or two steps down right away when the send queue
+ * backs up or sends fail, one step up after UPLINK_RATE_PROBE_WINDOWS clear windows.
+ * The complexity is also capped while the encoder uses too much of the frame time.
+ */
+
+#define UPLINK_MAX_OPUS_PACKET_SIZE 1000
+// A packet may take this many times the average size of the bitrate, which leaves room for VBR peaks
+#define UPLINK_OPUS_PACKET_PEAK_RATIO 2
+
+// Length of the measurement window, counted in audio time so pauses between sessions don't matter
+#define UPLINK_RATE_WINDOW_MS 1000
+// A backlog above this steps down, twice this steps down twice, below the low mark counts as clear
+#define UPLINK_BACKLOG_HIGH_MS 240
+#define UPLINK_BACKLOG_LOW_MS 60
+#define UPLINK_RATE_PROBE_WINDOWS 5
+// Encode time in percent of the frame duration
+#define UPLINK_ENCODE_LOAD_HIGH 60
+#define UPLINK_ENCODE_LOAD_LOW 30
+
+struct UplinkEncoderSettings {
+    int bitrate;        // bps
+    int complexity;     // 0 - 10
+    bool dtx;
+};
+
+class UplinkOpusEncoder {
+public:
+    UplinkOpusEncoder(int sample_rate, int channels, int duration_ms);
+    ~UplinkOpusEncoder();
+
+    UplinkOpusEncoder(const UplinkOpusEncoder&) = delete;
+    UplinkOpusEncoder& operator=(const UplinkOpusEncoder&) = delete;
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    void Apply(const UplinkEncoderSettings& settings);
+    // pcm must hold exactly one frame, the packet is written behind the first offset bytes of opus
+    bool Encode(const std::vector<int16_t>& pcm, std::vector<uint8_t>& opus, size_t offset = 0);
+    bool Encode(const int16_t* pcm, std::vector<uint8_t>& opus, size_t offset = 0);
+    inline int frame_size() const { return frame_size_; }
+    void ResetState();
+
+private:
+    OpusEncoder* encoder_ = nullptr;
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+    int frame_size_;
+    UplinkEncoderSettings settings_ = {-1, -1, false};     // Nothing applied yet, DTX is off by default
+};
+
+struct UplinkRateStatistics {
+    int level = 0;
+    UplinkEncoderSettings settings = {};
+    int backlog_ms = 0;         // Largest send queue depth of the last window
+    int encode_load = 0;        // Encode time in percent of the audio time, last window
+    uint32_t send_failures = 0;
+    uint32_t step_downs = 0;
+    uint32_t step_ups = 0;
+    uint32_t complexity_limits = 0;
+};
+
+class UplinkRateController {
+public:
+    UplinkRateController();
+
+    // Returns true if the settings changed and have to be applied to the encoder
+    bool OnFrameEncoded(int frame_duration_ms, int64_t encode_time_us, int backlog_ms, uint32_t send_failures);
+    UplinkEncoderSettings settings() const;
+    UplinkRateStatistics GetStatistics() const;
+
+private:
+    int level_;
+    int complexity_cap_;
+    int clear_windows_ = 0;
+    int low_load_windows_ = 0;
+
+    // Current window
+    int window_ms_ = 0;
+    int64_t window_encode_us_ = 0;
+    int window_backlog_ms_ = 0;
+    uint32_t window_failures_ = 0;
+
+    UplinkRateStatistics stats_;
+
+    bool EndWindow();
+};
+
+#endif // UPLINK_ENCODER_H
@@ -6,6 +6,10 @@
 #include <functional>
 
 #include "audio_codec.h"
+#include "protocol.h"
+
+// Audio kept before the wake word, sent to the server along with it (e.g. to identify the speaker)
+#define WAKE_WORD_PCM_DURATION_MS 2000
 
 class WakeWord {
 public:
@@ -18,7 +22,8 @@ public:
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EncodeWakeWordData() = 0;
-    virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
+    // Blocks until the next encoded packet is ready, returns nullptr after the last one
+    virtual AudioStreamPacketPtr GetWakeWordPacket() = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
 };
 
@@ -8,10 +8,11 @@
 
 #define TAG "AfeWakeWord"
 
-AfeWakeWord::AfeWakeWord()
-    : afe_data_(nullptr),
-      wake_word_pcm_(),
-      wake_word_opus_() {
+AfeWakeWord::AfeWakeWord(std::shared_ptr<AfeFrontEnd> front_end)
+    : front_end_(front_end),
+      afe_data_(nullptr),
+      wake_word_pcm_(16000 * WAKE_WORD_PCM_DURATION_MS / 1000),
+      wake_word_packets_() {
 
     event_group_ = xEventGroupCreate();
 }
@@ -40,16 +41,27 @@ bool AfeWakeWord::Initialize(AudioCodec* codec) {
     codec_ = codec;
     int ref_num = codec_->input_reference() ? 1 : 0;
 
-    models_ = esp_srmodel_init("model");
-    if (models_ == nullptr || models_->num == -1) {
+    srmodel_list_t* models = nullptr;
+    if (front_end_) {
+        front_end_->OnFetch(kAfeConsumerWakeWord, [this](afe_fetch_result_t* res) {
+            OnFetchResult(res);
+        });
+        if (front_end_->Initialize(codec_)) {
+            models = front_end_->models();
+        }
+    } else {
+        models_ = esp_srmodel_init("model");
+        models = models_;
+    }
+    if (models == nullptr || models->num == -1) {
         ESP_LOGE(TAG, "Failed to initialize wakenet model");
         return false;
     }
-    for (int i = 0; i < models_->num; i++) {
-        ESP_LOGI(TAG, "Model %d: %s", i, models_->model_name[i]);
-        if (strstr(models_->model_name[i], ESP_WN_PREFIX) != NULL) {
-            wakenet_model_ = models_->model_name[i];
-            auto words = esp_srmodel_get_wake_words(models_, wakenet_model_);
+    for (int i = 0; i < models->num; i++) {
+        ESP_LOGI(TAG, "Model %d: %s", i, models->model_name[i]);
+        if (strstr(models->model_name[i], ESP_WN_PREFIX) != NULL) {
+            wakenet_model_ = models->model_name[i];
+            auto words = esp_srmodel_get_wake_words(models, wakenet_model_);
             // split by ";" to get all wake words
             std::stringstream ss(words);
             std::string word;
@@ -58,6 +70,9 @@ bool AfeWakeWord::Initialize(AudioCodec* codec) {
             }
         }
     }
+    if (front_end_) {
+        return true;
+    }
 
     std::string input_format;
     for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
@@ -90,10 +105,18 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
 }
 
 void AfeWakeWord::Start() {
+    if (front_end_) {
+        front_end_->StartConsumer(kAfeConsumerWakeWord);
+        return;
+    }
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
 
 void AfeWakeWord::Stop() {
+    if (front_end_) {
+        front_end_->StopConsumer(kAfeConsumerWakeWord);
+        return;
+    }
     xEventGroupClearBits(event_group_, DETECTION_RUNNING_EVENT);
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
@@ -101,6 +124,10 @@ void AfeWakeWord::Stop() {
 }
 
 void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
+    if (front_end_) {
+        front_end_->Feed(data.data());
+        return;
+    }
     if (afe_data_ == nullptr) {
         return;
     }
@@ -108,6 +135,9 @@ void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
 }
 
 size_t AfeWakeWord::GetFeedSize() {
+    if (front_end_) {
+        return front_end_->GetFeedSize();
+    }
     if (afe_data_ == nullptr) {
         return 0;
     }
@@ -128,32 +158,32 @@ void AfeWakeWord::AudioDetectionTask() {
             continue;;
         }
 
-        // Store the wake word data for voice recognition, like who is speaking
-        StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
+        OnFetchResult(res);
+    }
+}
+
+void AfeWakeWord::OnFetchResult(afe_fetch_result_t* res) {
+    // Store the wake word data for voice recognition, like who is speaking
+    StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
 
-        if (res->wakeup_state == WAKENET_DETECTED) {
-            Stop();
-            last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
+    if (res->wakeup_state == WAKENET_DETECTED) {
+        Stop();
+        last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
 
-            if (wake_word_detected_callback_) {
-                wake_word_detected_callback_(last_detected_wake_word_);
-            }
+        if (wake_word_detected_callback_) {
+            wake_word_detected_callback_(last_detected_wake_word_);
         }
     }
 }
 
 void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
-    }
+    // The ring keeps the last WAKE_WORD_PCM_DURATION_MS (sample_rate == 16000), without allocating
+    wake_word_pcm_.Write(data, samples);
 }
 
 void AfeWakeWord::EncodeWakeWordData() {
     const size_t stack_size = 4096 * 7;
-    wake_word_opus_.clear();
+    wake_word_packets_.clear();
     if (wake_word_encode_task_stack_ == nullptr) {
         wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
         assert(wake_word_encode_task_stack_ != nullptr);
@@ -167,37 +197,45 @@ void AfeWakeWord::EncodeWakeWordData() {
         auto this_ = (AfeWakeWord*)arg;
         {
             auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            int packets = 0;
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
-                packets++;
-            }
-            this_->wake_word_pcm_.clear();
+            // Complexity 0 by default, the fastest
+            auto encoder = std::make_unique<UplinkOpusEncoder>(16000, 1, OPUS_FRAME_DURATION_MS);
+
+            // The frames are encoded in place, only the one that wraps around the ring is copied
+            std::vector<int16_t> scratch(encoder->frame_size());
+            int packets = this_->wake_word_pcm_.ForEachFrame(scratch.size(), scratch.data(), [this_, &encoder](const int16_t* frame) {
+                // Encoded behind the room for the transport header, like the packets of the send queue
+                auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+                packet->sample_rate = 16000;
+                packet->frame_duration = OPUS_FRAME_DURATION_MS;
+                packet->headroom = AUDIO_STREAM_PACKET_HEADROOM;
+                packet->payload.resize(packet->headroom);
+                if (!encoder->Encode(frame, packet->payload, packet->headroom)) {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
+                this_->wake_word_packets_.emplace_back(std::move(packet));
+                this_->wake_word_cv_.notify_all();
+            });
+            this_->wake_word_pcm_.Clear();
 
             auto end_time = esp_timer_get_time();
             ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
 
             std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
+            // A null packet marks the end
+            this_->wake_word_packets_.push_back(nullptr);
             this_->wake_word_cv_.notify_all();
         }
         vTaskDelete(NULL);
     }, "encode_wake_word", stack_size, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
 }
 
-bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
+AudioStreamPacketPtr AfeWakeWord::GetWakeWordPacket() {
     std::unique_lock<std::mutex> lock(wake_word_mutex_);
     wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
+        return !wake_word_packets_.empty();
     });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    auto packet = std::move(wake_word_packets_.front());
+    wake_word_packets_.pop_front();
+    return packet;
 }
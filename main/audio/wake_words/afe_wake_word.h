@@ -15,13 +15,17 @@
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <memory>
 
 #include "audio_codec.h"
 #include "wake_word.h"
+#include "pcm_ring_buffer.h"
+#include "processors/afe_front_end.h"
 
 class AfeWakeWord : public WakeWord {
 public:
-    AfeWakeWord();
+    // With a front end, WakeNet runs in the shared AFE instead of one of its own
+    explicit AfeWakeWord(std::shared_ptr<AfeFrontEnd> front_end = nullptr);
     ~AfeWakeWord();
 
     bool Initialize(AudioCodec* codec);
@@ -31,10 +35,11 @@ public:
     void Stop();
     size_t GetFeedSize();
     void EncodeWakeWordData();
-    bool GetWakeWordOpus(std::vector<uint8_t>& opus);
+    AudioStreamPacketPtr GetWakeWordPacket();
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
+    std::shared_ptr<AfeFrontEnd> front_end_;
     srmodel_list_t *models_ = nullptr;
     esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
@@ -48,13 +53,14 @@ private:
     TaskHandle_t wake_word_encode_task_ = nullptr;
     StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
     StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
+    PcmRingBuffer wake_word_pcm_;
+    std::deque<AudioStreamPacketPtr> wake_word_packets_;
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
 
     void StoreWakeWordData(const int16_t* data, size_t size);
     void AudioDetectionTask();
+    void OnFetchResult(afe_fetch_result_t* res);
 };
 
 #endif
@@ -12,7 +12,7 @@
 
 
 CustomWakeWord::CustomWakeWord()
-    : wake_word_pcm_(), wake_word_opus_() {
+    : wake_word_pcm_(16000 * WAKE_WORD_PCM_DURATION_MS / 1000), wake_word_packets_() {
 }
 
 CustomWakeWord::~CustomWakeWord() {
@@ -55,6 +55,7 @@ bool CustomWakeWord::Initialize(AudioCodec* codec) {
     multinet_ = esp_mn_handle_from_name(mn_name_);
     multinet_model_data_ = multinet_->create(mn_name_, 3000);  // 3 秒超时
     multinet_->set_det_threshold(multinet_model_data_, CONFIG_CUSTOM_WAKE_WORD_THRESHOLD / 100.0f);
+    feed_assembler_.SetFrameSamples(multinet_->get_samp_chunksize(multinet_model_data_));
     esp_mn_commands_clear();
     esp_mn_commands_add(1, CONFIG_CUSTOM_WAKE_WORD);
     esp_mn_commands_update();
@@ -80,21 +81,19 @@ void CustomWakeWord::Feed(const std::vector<int16_t>& data) {
         return;
     }
 
-    esp_mn_state_t mn_state;
-    // If input channels is 2, we need to fetch the left channel data
-    if (codec_->input_channels() == 2) {
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
-        }
+    // If input channels is 2, the assembler takes the left channel data
+    feed_assembler_.Push(data.data(), data.size(), [this](const int16_t* frame, size_t samples) {
+        DetectFrame(frame, samples);
+    }, codec_->input_channels());
+}
 
-        StoreWakeWordData(mono_data);
-        mn_state = multinet_->detect(multinet_model_data_, const_cast<int16_t*>(mono_data.data()));
-    } else {
-        StoreWakeWordData(data);
-        mn_state = multinet_->detect(multinet_model_data_, const_cast<int16_t*>(data.data()));
+void CustomWakeWord::DetectFrame(const int16_t* frame, size_t samples) {
+    if (!running_) {
+        return;
     }
-    
+
+    StoreWakeWordData(frame, samples);
+    esp_mn_state_t mn_state = multinet_->detect(multinet_model_data_, const_cast<int16_t*>(frame));
     if (mn_state == ESP_MN_STATE_DETECTING) {
         return;
     } else if (mn_state == ESP_MN_STATE_DETECTED) {
@@ -124,18 +123,14 @@ size_t CustomWakeWord::GetFeedSize() {
     return multinet_->get_samp_chunksize(multinet_model_data_) * codec_->input_channels();
 }
 
-void CustomWakeWord::StoreWakeWordData(const std::vector<int16_t>& data) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.push_back(data);
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
-    }
+void CustomWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
+    // The ring keeps the last WAKE_WORD_PCM_DURATION_MS (sample_rate == 16000), without allocating
+    wake_word_pcm_.Write(data, samples);
 }
 
 void CustomWakeWord::EncodeWakeWordData() {
     const size_t stack_size = 4096 * 7;
-    wake_word_opus_.clear();
+    wake_word_packets_.clear();
     if (wake_word_encode_task_stack_ == nullptr) {
         wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
         assert(wake_word_encode_task_stack_ != nullptr);
@@ -149,37 +144,45 @@ void CustomWakeWord::EncodeWakeWordData() {
         auto this_ = (CustomWakeWord*)arg;
         {
             auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            int packets = 0;
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
-                packets++;
-            }
-            this_->wake_word_pcm_.clear();
+            // Complexity 0 by default, the fastest
+            auto encoder = std::make_unique<UplinkOpusEncoder>(16000, 1, OPUS_FRAME_DURATION_MS);
+
+            // The frames are encoded in place, only the one that wraps around the ring is copied
+            std::vector<int16_t> scratch(encoder->frame_size());
+            int packets = this_->wake_word_pcm_.ForEachFrame(scratch.size(), scratch.data(), [this_, &encoder](const int16_t* frame) {
+                // Encoded behind the room for the transport header, like the packets of the send queue
+                auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+                packet->sample_rate = 16000;
+                packet->frame_duration = OPUS_FRAME_DURATION_MS;
+                packet->headroom = AUDIO_STREAM_PACKET_HEADROOM;
+                packet->payload.resize(packet->headroom);
+                if (!encoder->Encode(frame, packet->payload, packet->headroom)) {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
+                this_->wake_word_packets_.emplace_back(std::move(packet));
+                this_->wake_word_cv_.notify_all();
+            });
+            this_->wake_word_pcm_.Clear();
 
             auto end_time = esp_timer_get_time();
             ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
 
             std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
+            // A null packet marks the end
+            this_->wake_word_packets_.push_back(nullptr);
             this_->wake_word_cv_.notify_all();
         }
         vTaskDelete(NULL);
     }, "encode_wake_word", stack_size, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
 }
 
-bool CustomWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
+AudioStreamPacketPtr CustomWakeWord::GetWakeWordPacket() {
     std::unique_lock<std::mutex> lock(wake_word_mutex_);
     wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
+        return !wake_word_packets_.empty();
     });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    auto packet = std::move(wake_word_packets_.front());
+    wake_word_packets_.pop_front();
+    return packet;
 }
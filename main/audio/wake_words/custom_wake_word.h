@@ -16,6 +16,8 @@
 
 #include "audio_codec.h"
 #include "wake_word.h"
+#include "pcm_ring_buffer.h"
+#include "frame_assembler.h"
 
 class CustomWakeWord : public WakeWord {
 public:
@@ -29,7 +31,7 @@ public:
     void Stop();
     size_t GetFeedSize();
     void EncodeWakeWordData();
-    bool GetWakeWordOpus(std::vector<uint8_t>& opus);
+    AudioStreamPacketPtr GetWakeWordPacket();
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
@@ -47,12 +49,14 @@ private:
     TaskHandle_t wake_word_encode_task_ = nullptr;
     StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
     StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
+    PcmRingBuffer wake_word_pcm_;
+    FrameAssembler feed_assembler_;
+    std::deque<AudioStreamPacketPtr> wake_word_packets_;
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
 
-    void StoreWakeWordData(const std::vector<int16_t>& data);
+    void DetectFrame(const int16_t* frame, size_t samples);
+    void StoreWakeWordData(const int16_t* data, size_t samples);
 };
 
 #endif
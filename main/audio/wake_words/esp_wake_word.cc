@@ -77,6 +77,6 @@ size_t EspWakeWord::GetFeedSize() {
 void EspWakeWord::EncodeWakeWordData() {
 }
 
-bool EspWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
-    return false;
+AudioStreamPacketPtr EspWakeWord::GetWakeWordPacket() {
+    return nullptr;
 }
@@ -25,7 +25,7 @@ public:
     void Stop();
     size_t GetFeedSize();
     void EncodeWakeWordData();
-    bool GetWakeWordOpus(std::vector<uint8_t>& opus);
+    AudioStreamPacketPtr GetWakeWordPacket();
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
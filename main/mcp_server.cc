@@ -103,6 +103,22 @@ void McpServer::AddCommonTools() {
             });
     }
 
+    AddTool("self.audio.get_latency_stats",
+        "Get the latency histograms of the audio pipeline stages, from mic capture to send and from receive to playback.\n"
+        "Args:\n"
+        "  `reset`: Clear the histograms after reading them.",
+        PropertyList({
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& audio_service = Application::GetInstance().GetAudioService();
+            auto json = audio_service.GetLatencyStatsJson();
+            if (properties["reset"].value<bool>()) {
+                audio_service.ResetLatencyStats();
+            }
+            return json;
+        });
+
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
 }
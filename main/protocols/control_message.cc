@@ -0,0 +1,277 @@
+#include "control_message.h"
+
+#include <array>
+
+struct ControlMessageTypeName {
+    std::string_view name;
+    ControlMessageType type;
+};
+
+static constexpr ControlMessageTypeName kControlMessageTypeNames[] = {
+    {"hello", kControlMessageHello},
+    {"goodbye", kControlMessageGoodbye},
+    {"tts", kControlMessageTts},
+    {"stt", kControlMessageStt},
+    {"llm", kControlMessageLlm},
+    {"mcp", kControlMessageMcp},
+    {"system", kControlMessageSystem},
+    {"alert", kControlMessageAlert},
+    {"custom", kControlMessageCustom},
+};
+
+#define CONTROL_MESSAGE_TYPE_SLOTS 16
+
+// The first two characters and the length tell the types apart, see the static_assert below
+static constexpr size_t HashControlMessageType(std::string_view name) {
+    return (uint8_t(name[0]) * 2 + uint8_t(name[1]) + name.size()) % CONTROL_MESSAGE_TYPE_SLOTS;
+}
+
+// Slot -> index in kControlMessageTypeNames + 1, 0 for an empty slot
+static constexpr std::array<uint8_t, CONTROL_MESSAGE_TYPE_SLOTS> BuildControlMessageTypeTable() {
+    std::array<uint8_t, CONTROL_MESSAGE_TYPE_SLOTS> table = {};
+    for (size_t i = 0; i < std::size(kControlMessageTypeNames); i++) {
+        table[HashControlMessageType(kControlMessageTypeNames[i].name)] = i + 1;
+    }
+    return table;
+}
+
+static constexpr auto kControlMessageTypeTable = BuildControlMessageTypeTable();
+
+static constexpr bool IsControlMessageTypeTablePerfect() {
+    for (size_t i = 0; i < std::size(kControlMessageTypeNames); i++) {
+        if (kControlMessageTypeTable[HashControlMessageType(kControlMessageTypeNames[i].name)] != i + 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(IsControlMessageTypeTablePerfect(), "Control message types collide, change HashControlMessageType");
+
+ControlMessageType LookupControlMessageType(std::string_view name) {
+    if (name.size() < 2) {
+        return kControlMessageUnknown;
+    }
+    int index = kControlMessageTypeTable[HashControlMessageType(name)];
+    if (index == 0 || kControlMessageTypeNames[index - 1].name != name) {
+        return kControlMessageUnknown;
+    }
+    return kControlMessageTypeNames[index - 1].type;
+}
+
+static void SkipWhitespace(char*& p, char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool ParseHex4(char* p, char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = HexValue(p[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+// p points behind the opening quote. The string is unescaped in place, the result is never longer than the input
+static bool ParseString(char*& p, char* end, std::string_view& value) {
+    char* start = p;
+    char* out = p;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            value = std::string_view(start, out - start);
+            p++;
+            return true;
+        }
+        if (uint8_t(c) < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        if (end - p < 2) {
+            return false;
+        }
+        char escape = p[1];
+        p += 2;
+        switch (escape) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!ParseHex4(p, end, code)) {
+                    return false;
+                }
+                p += 4;
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ParseHex4(p + 2, end, low) ||
+                        low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    p += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                    return false;
+                }
+                // UTF-8 takes at most as many bytes as the escape sequence
+                if (code < 0x80) {
+                    *out++ = code;
+                } else if (code < 0x800) {
+                    *out++ = 0xC0 | (code >> 6);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else if (code < 0x10000) {
+                    *out++ = 0xE0 | (code >> 12);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else {
+                    *out++ = 0xF0 | (code >> 18);
+                    *out++ = 0x80 | ((code >> 12) & 0x3F);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+// Skips a number, literal, object or array, nested strings are not unescaped
+static bool SkipValue(char*& p, char* end) {
+    int depth = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            p++;
+            while (p < end && *p != '"') {
+                p += (*p == '\\') ? 2 : 1;
+            }
+            if (p >= end) {
+                return false;
+            }
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return true;
+            }
+            depth--;
+        } else if (depth == 0 && (c == ',' || c == ' ' || c == '\t' || c == '\n' || c == '\r')) {
+            return true;
+        }
+        p++;
+    }
+    return depth == 0;
+}
+
+bool ControlMessage::Parse(char* data, size_t size) {
+    field_count_ = 0;
+    type_ = kControlMessageUnknown;
+
+    char* p = data;
+    char* end = data + size;
+    SkipWhitespace(p, end);
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    p++;
+    SkipWhitespace(p, end);
+    if (p < end && *p == '}') {
+        return false;
+    }
+
+    while (p < end) {
+        if (*p != '"' || field_count_ == CONTROL_MESSAGE_MAX_FIELDS) {
+            return false;
+        }
+        p++;
+        auto& field = fields_[field_count_];
+        if (!ParseString(p, end, field.key)) {
+            return false;
+        }
+        SkipWhitespace(p, end);
+        if (p >= end || *p != ':') {
+            return false;
+        }
+        p++;
+        SkipWhitespace(p, end);
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '"') {
+            p++;
+            if (!ParseString(p, end, field.value)) {
+                return false;
+            }
+            field.is_string = true;
+        } else {
+            char* start = p;
+            if (!SkipValue(p, end) || p == start) {
+                return false;
+            }
+            field.value = std::string_view(start, p - start);
+            field.is_string = false;
+        }
+        field_count_++;
+
+        SkipWhitespace(p, end);
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '}') {
+            auto type = GetString("type");
+            if (!type) {
+                return false;
+            }
+            type_ = LookupControlMessageType(*type);
+            return true;
+        }
+        if (*p != ',') {
+            return false;
+        }
+        p++;
+        SkipWhitespace(p, end);
+    }
+    return false;
+}
+
+std::optional<std::string_view> ControlMessage::GetString(std::string_view key) const {
+    for (int i = 0; i < field_count_; i++) {
+        if (fields_[i].key == key) {
+            if (!fields_[i].is_string) {
+                return std::nullopt;
+            }
+            return fields_[i].value;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,58 @@
+#ifndef CONTROL_MESSAGE_H
+#define CONTROL_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/*
+ * Text (JSON) messages from the server, without a cJSON tree.
+ *
+ * The type is looked up in a perfect hash table that is checked at compile time. ControlMessage
+ * tokenizes the top level of a message in place: string values are unescaped in the buffer and
+ * handed out as string_views into it, nested objects and arrays are kept as raw spans. The buffer
+ * is the arena of the protocol, the views are only valid during the callback.
+ */
+
+enum ControlMessageType {
+    kControlMessageUnknown = 0,
+    kControlMessageHello,
+    kControlMessageGoodbye,
+    kControlMessageTts,
+    kControlMessageStt,
+    kControlMessageLlm,
+    kControlMessageMcp,
+    kControlMessageSystem,
+    kControlMessageAlert,
+    kControlMessageCustom,
+};
+
+ControlMessageType LookupControlMessageType(std::string_view name);
+
+#define CONTROL_MESSAGE_MAX_FIELDS 12
+// Longer messages take the cJSON path
+#define CONTROL_MESSAGE_ARENA_SIZE 2048
+
+class ControlMessage {
+public:
+    // Tokenizes the JSON object in data, which is modified, returns false if it is not valid or has no type
+    bool Parse(char* data, size_t size);
+
+    inline ControlMessageType type() const { return type_; }
+    // The unescaped value of a string field, nullopt if the field is missing or not a string
+    std::optional<std::string_view> GetString(std::string_view key) const;
+
+private:
+    struct Field {
+        std::string_view key;
+        std::string_view value;
+        bool is_string;
+    };
+
+    Field fields_[CONTROL_MESSAGE_MAX_FIELDS];
+    int field_count_ = 0;
+    ControlMessageType type_ = kControlMessageUnknown;
+};
+
+#endif // CONTROL_MESSAGE_H
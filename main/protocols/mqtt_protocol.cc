@@ -12,10 +12,16 @@
 
 MqttProtocol::MqttProtocol() {
     event_group_handle_ = xEventGroupCreate();
+    mbedtls_aes_init(&send_aes_ctx_);
+    mbedtls_aes_init(&receive_aes_ctx_);
+    send_buffer_.reserve(AUDIO_STREAM_PACKET_HEADROOM + AUDIO_STREAM_PACKET_RESERVED_SIZE);
 }
 
 MqttProtocol::~MqttProtocol() {
     ESP_LOGI(TAG, "MqttProtocol deinit");
+    udp_.reset();
+    mbedtls_aes_free(&send_aes_ctx_);
+    mbedtls_aes_free(&receive_aes_ctx_);
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -54,6 +60,9 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+        if (DispatchControlMessage(payload.data(), payload.size())) {
+            return;
+        }
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -115,30 +124,33 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
-bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool MqttProtocol::SendAudio(AudioStreamPacketPtr packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
+    // The nonce and the payload are encrypted straight into the send buffer, nothing is allocated per packet
+    size_t payload_size = packet->opus_size();
+    send_buffer_.resize(aes_nonce_.size() + payload_size);
+    auto nonce = (uint8_t*)send_buffer_.data();
+    memcpy(nonce, aes_nonce_.data(), aes_nonce_.size());
+    *(uint16_t*)&nonce[2] = htons(payload_size);
     *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
     *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
 
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
-
+    // CTR advances the counter it is given, the nonce in the header stays as it is
+    uint8_t counter[16];
+    memcpy(counter, nonce, sizeof(counter));
     size_t nc_off = 0;
     uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+    if (mbedtls_aes_crypt_ctr(&send_aes_ctx_, payload_size, &nc_off, counter, stream_block,
+        packet->opus_data(), nonce + aes_nonce_.size()) != 0) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    return udp_->Send(send_buffer_) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -192,7 +204,7 @@ bool MqttProtocol::OpenAudioChannel() {
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < aes_nonce_.size()) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
@@ -202,25 +214,31 @@ bool MqttProtocol::OpenAudioChannel() {
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
+        // Out of order packets are kept, the jitter buffer puts them back in sequence
         if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+            ESP_LOGD(TAG, "Received audio packet with unexpected sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
         }
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
+        size_t payload_size = ntohs(*(uint16_t*)&data[2]);
+        if (payload_size > data.size() - aes_nonce_.size()) {
+            ESP_LOGE(TAG, "Invalid audio payload size: %u, packet size: %u", payload_size, data.size());
+            return;
+        }
+
+        // Decrypted straight into the pooled packet, the receive buffer is left as it is
+        uint8_t counter[16];
+        memcpy(counter, data.data(), sizeof(counter));
         size_t nc_off = 0;
         uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
+        auto encrypted = (const uint8_t*)data.data() + aes_nonce_.size();
+        auto packet = AudioStreamPacketPool::GetInstance().Acquire();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
         packet->timestamp = timestamp;
-        packet->payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
+        packet->sequence = sequence;
+        packet->has_sequence = true;
+        packet->payload.resize(payload_size);
+        int ret = mbedtls_aes_crypt_ctr(&receive_aes_ctx_, payload_size, &nc_off, counter, stream_block, encrypted, packet->payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
             return;
@@ -228,7 +246,9 @@ bool MqttProtocol::OpenAudioChannel() {
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
+        if (int32_t(sequence - remote_sequence_) > 0) {
+            remote_sequence_ = sequence;
+        }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -256,7 +276,7 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", client_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -290,6 +310,9 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
             server_frame_duration_ = frame_duration->valueint;
         }
     }
+    // frame_duration above is the downlink, the server answers the uplink proposal separately
+    auto uplink_frame_duration = cJSON_IsObject(audio_params) ? cJSON_GetObjectItem(audio_params, "uplink_frame_duration") : nullptr;
+    AcceptUplinkFrameDuration(cJSON_IsNumber(uplink_frame_duration) ? uplink_frame_duration->valueint : 0);
 
     auto udp = cJSON_GetObjectItem(root, "udp");
     if (!cJSON_IsObject(udp)) {
@@ -304,8 +327,10 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
     aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
+    // CTR only uses the encryption key schedule, in both directions
+    auto aes_key = DecodeHexString(key);
+    mbedtls_aes_setkey_enc(&send_aes_ctx_, (const unsigned char*)aes_key.c_str(), 128);
+    mbedtls_aes_setkey_enc(&receive_aes_ctx_, (const unsigned char*)aes_key.c_str(), 128);
     local_sequence_ = 0;
     remote_sequence_ = 0;
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
@@ -26,7 +26,7 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacketPtr packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
@@ -39,8 +39,11 @@ private:
     std::mutex channel_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
-    mbedtls_aes_context aes_ctx_;
+    // One context per direction, the receive task and the sender don't share one
+    mbedtls_aes_context send_aes_ctx_;
+    mbedtls_aes_context receive_aes_ctx_;
     std::string aes_nonce_;
+    std::string send_buffer_;       // Nonce and encrypted payload of the packet being sent, keeps its capacity
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
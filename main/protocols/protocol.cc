@@ -1,14 +1,49 @@
 #include "protocol.h"
 
 #include <esp_log.h>
+#include <cstring>
 
 #define TAG "Protocol"
 
+AudioStreamPacketPool::AudioStreamPacketPool()
+    : FramePool<AudioStreamPacket>("audio_packet", AUDIO_STREAM_PACKET_POOL_SIZE, [index = 0](AudioStreamPacket& packet) mutable {
+        // The free list is LIFO, the last packets are handed out first
+        if (index++ >= AUDIO_STREAM_PACKET_POOL_SIZE - AUDIO_STREAM_PACKET_RESERVED_COUNT) {
+            packet.payload.reserve(AUDIO_STREAM_PACKET_RESERVED_SIZE);
+        }
+    }) {
+}
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
+void Protocol::OnIncomingMessage(std::function<void(const ControlMessage& message)> callback) {
+    on_incoming_message_ = callback;
+}
+
+bool Protocol::DispatchControlMessage(const char* data, size_t size) {
+    if (on_incoming_message_ == nullptr || size >= sizeof(message_arena_)) {
+        return false;
+    }
+
+    // Tokenized in the arena, which is reused for every message
+    memcpy(message_arena_, data, size);
+    if (!control_message_.Parse(message_arena_, size)) {
+        return false;
+    }
+    switch (control_message_.type()) {
+        case kControlMessageTts:
+        case kControlMessageStt:
+        case kControlMessageLlm:
+            on_incoming_message_(control_message_);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
@@ -24,6 +59,19 @@ void Protocol::OnNetworkError(std::function<void(const std::string& message)> ca
     on_network_error_ = callback;
 }
 
+void Protocol::AcceptUplinkFrameDuration(int frame_duration) {
+    uplink_frame_duration_ = client_frame_duration_;
+    if (frame_duration == 0 || frame_duration == client_frame_duration_) {
+        return;
+    }
+    if (frame_duration != 20 && frame_duration != 40 && frame_duration != 60) {
+        ESP_LOGW(TAG, "Server accepted an unsupported uplink frame duration %d ms, keeping %d ms", frame_duration, client_frame_duration_);
+        return;
+    }
+    ESP_LOGI(TAG, "Server accepted uplink frame duration %d ms instead of %d ms", frame_duration, client_frame_duration_);
+    uplink_frame_duration_ = frame_duration;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -6,12 +6,79 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <memory>
+
+#include "frame_pool.h"
+#include "audio_latency.h"
+#include "control_message.h"
+
+// The packet queues of the audio service hold this much audio, they are allocated for the shortest frames
+#define AUDIO_QUEUE_DURATION_MS 2400
+#define MIN_OPUS_FRAME_DURATION_MS 20
+#define MAX_DECODE_PACKETS_IN_QUEUE (AUDIO_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS)
+#define MAX_SEND_PACKETS_IN_QUEUE (AUDIO_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS)
+// WAKE_WORD_PCM_DURATION_MS encoded at OPUS_FRAME_DURATION_MS while the channel opens, plus the end marker
+#define MAX_WAKE_WORD_PACKETS (2000 / 60 + 2)
+// Held outside the queues: the network task, the codec task and the one being sent or decoded
+#define AUDIO_STREAM_PACKETS_IN_FLIGHT 4
+// Both queues full at the same time, so a slow link never falls back to the heap.
+// The audio testing queue is only used outside a conversation and fits in the same packets.
+#define AUDIO_STREAM_PACKET_POOL_SIZE (MAX_SEND_PACKETS_IN_QUEUE + MAX_DECODE_PACKETS_IN_QUEUE + \
+    MAX_WAKE_WORD_PACKETS + AUDIO_STREAM_PACKETS_IN_FLIGHT)
+// Only the packets handed out first get their payload up front, the others allocate it on first use
+// and keep it, so the internal RAM of a deep queue is only spent when the queue gets that deep
+#define AUDIO_STREAM_PACKET_RESERVED_COUNT 48
+#define AUDIO_STREAM_PACKET_RESERVED_SIZE 256
+// Room for the largest transport header (BinaryProtocol2, the MQTT nonce) in front of uplink audio
+#define AUDIO_STREAM_PACKET_HEADROOM 16
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;
+    bool has_sequence = false;      // False if the transport has no sequence numbers (websocket)
+    AudioFrameTimes times;
     std::vector<uint8_t> payload;
+    size_t headroom = 0;            // Bytes in front of the Opus data in payload, free for the transport header
+
+    inline const uint8_t* opus_data() const { return payload.data() + headroom; }
+    inline size_t opus_size() const { return payload.size() - headroom; }
+
+    // Returns room for a header of size bytes right in front of the Opus data, so the header and the
+    // data go out as one frame. Packets from the encoder have it already, others are shifted once.
+    uint8_t* PrependHeader(size_t size) {
+        if (headroom < size) {
+            payload.insert(payload.begin(), size - headroom, 0);
+            headroom = size;
+        }
+        return payload.data() + headroom - size;
+    }
+
+    void Reset() {
+        sample_rate = 0;
+        frame_duration = 0;
+        timestamp = 0;
+        sequence = 0;
+        has_sequence = false;
+        times = {};
+        payload.clear();
+        headroom = 0;
+    }
+};
+
+using AudioStreamPacketPtr = FramePool<AudioStreamPacket>::Handle;
+
+// Shared by the audio service and the protocols, packets return to it when their handle is released
+class AudioStreamPacketPool : public FramePool<AudioStreamPacket> {
+public:
+    static AudioStreamPacketPool& GetInstance() {
+        static AudioStreamPacketPool instance;
+        return instance;
+    }
+
+private:
+    AudioStreamPacketPool();
 };
 
 struct BinaryProtocol2 {
@@ -51,12 +118,25 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    inline int client_frame_duration() const {
+        return client_frame_duration_;
+    }
+    // Uplink frame duration announced in the hello message, takes effect when the audio channel is opened next
+    inline void SetClientFrameDuration(int frame_duration) {
+        client_frame_duration_ = frame_duration;
+    }
+    // Uplink frame duration of the open audio channel: the announced one, unless the server's hello accepted another
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
+    void OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // tts, stt and llm messages skip cJSON and come here instead of OnIncomingJson
+    void OnIncomingMessage(std::function<void(const ControlMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -65,7 +145,7 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    virtual bool SendAudio(AudioStreamPacketPtr packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -74,13 +154,16 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
+    std::function<void(const ControlMessage& message)> on_incoming_message_;
+    std::function<void(AudioStreamPacketPtr packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int client_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
@@ -88,6 +171,14 @@ protected:
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    // Called by the receive task, returns false if the message has to go through cJSON
+    bool DispatchControlMessage(const char* data, size_t size);
+    // audio_params.uplink_frame_duration of the server's hello, 0 if it has none
+    void AcceptUplinkFrameDuration(int frame_duration);
+
+private:
+    char message_arena_[CONTROL_MESSAGE_ARENA_SIZE];
+    ControlMessage control_message_;
 };
 
 #endif // PROTOCOL_H
@@ -25,38 +25,68 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool WebsocketProtocol::SendAudio(AudioStreamPacketPtr packet) {
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
+    // The header is written into the headroom of the packet, header and payload are sent without a copy
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        auto bp2 = (BinaryProtocol2*)packet->PrependHeader(sizeof(BinaryProtocol2));
         bp2->version = htons(version_);
         bp2->type = 0;
         bp2->reserved = 0;
         bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
+        bp2->payload_size = htonl(packet->opus_size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        return websocket_->Send(bp2, sizeof(BinaryProtocol2) + packet->opus_size(), true);
     } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        auto bp3 = (BinaryProtocol3*)packet->PrependHeader(sizeof(BinaryProtocol3));
         bp3->type = 0;
         bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+        bp3->payload_size = htons(packet->opus_size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        return websocket_->Send(bp3, sizeof(BinaryProtocol3) + packet->opus_size(), true);
     } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+        return websocket_->Send(packet->opus_data(), packet->opus_size(), true);
     }
 }
 
+void WebsocketProtocol::OnAudioFrame(const uint8_t* data, size_t len) {
+    // The header is read in place and checked against the frame length, the receive buffer is not modified
+    uint32_t timestamp = 0;
+    const uint8_t* payload = data;
+    size_t payload_size = len;
+    if (version_ == 2) {
+        auto bp2 = (const BinaryProtocol2*)data;
+        if (len < sizeof(BinaryProtocol2) || ntohl(bp2->payload_size) > len - sizeof(BinaryProtocol2)) {
+            malformed_frames_++;
+            ESP_LOGW(TAG, "Malformed audio frame of %u bytes, %lu dropped", len, malformed_frames_);
+            return;
+        }
+        timestamp = ntohl(bp2->timestamp);
+        payload = bp2->payload;
+        payload_size = ntohl(bp2->payload_size);
+    } else if (version_ == 3) {
+        auto bp3 = (const BinaryProtocol3*)data;
+        if (len < sizeof(BinaryProtocol3) || ntohs(bp3->payload_size) > len - sizeof(BinaryProtocol3)) {
+            malformed_frames_++;
+            ESP_LOGW(TAG, "Malformed audio frame of %u bytes, %lu dropped", len, malformed_frames_);
+            return;
+        }
+        payload = bp3->payload;
+        payload_size = ntohs(bp3->payload_size);
+    }
+
+    auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+    packet->sample_rate = server_sample_rate_;
+    packet->frame_duration = server_frame_duration_;
+    packet->timestamp = timestamp;
+    // The only copy on the way to the decoder, into the capacity the pooled packet keeps
+    packet->payload.assign(payload, payload + payload_size);
+    on_incoming_audio_(std::move(packet));
+}
+
 bool WebsocketProtocol::SendText(const std::string& text) {
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
@@ -111,40 +141,9 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
-                } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
-                }
+                OnAudioFrame((const uint8_t*)data, len);
             }
-        } else {
+        } else if (!DispatchControlMessage(data, len)) {
             // Parse JSON data
             auto root = cJSON_Parse(data);
             auto type = cJSON_GetObjectItem(root, "type");
@@ -215,7 +214,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", client_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -248,6 +247,9 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
             server_frame_duration_ = frame_duration->valueint;
         }
     }
+    // frame_duration above is the downlink, the server answers the uplink proposal separately
+    auto uplink_frame_duration = cJSON_IsObject(audio_params) ? cJSON_GetObjectItem(audio_params, "uplink_frame_duration") : nullptr;
+    AcceptUplinkFrameDuration(cJSON_IsNumber(uplink_frame_duration) ? uplink_frame_duration->valueint : 0);
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
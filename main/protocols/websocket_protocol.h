@@ -16,7 +16,7 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacketPtr packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
@@ -25,8 +25,10 @@ private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
+    uint32_t malformed_frames_ = 0;
 
     void ParseServerHello(const cJSON* root);
+    void OnAudioFrame(const uint8_t* data, size_t len);
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
 };
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "audio_kernels.h"
+
+// Every 16-bit value once, in a scrambled order so neighbours differ
+static std::vector<int16_t> AllSamples() {
+    std::vector<int16_t> pcm(65536);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = int16_t(uint16_t(i * 40503));
+    }
+    return pcm;
+}
+
+// The per-sample loops NoAudioCodec had before the kernels
+static int32_t ReferenceScale(int16_t sample, int volume) {
+    int32_t volume_factor = pow(double(volume) / 100.0, 2) * 65536;
+    int64_t temp = int64_t(sample) * volume_factor;
+    return std::clamp<int64_t>(temp, INT32_MIN, INT32_MAX);
+}
+
+static int16_t ReferenceConvert(int32_t sample, int shift) {
+    return std::clamp<int32_t>(sample >> shift, -32767, 32767);
+}
+
+TEST(AudioKernels, VolumeToGainFollowsTheSquareCurve) {
+    for (int volume = 0; volume <= 100; volume++) {
+        int32_t expected = pow(double(volume) / 100.0, 2) * 65536;
+        // The float curve may round one step lower
+        EXPECT_NEAR(VolumeToGain(volume), expected, 1) << "volume " << volume;
+    }
+    EXPECT_EQ(VolumeToGain(0), 0);
+    EXPECT_EQ(VolumeToGain(100), 65536);
+    EXPECT_EQ(VolumeToGain(-5), 0);
+    EXPECT_EQ(VolumeToGain(150), 65536);
+}
+
+TEST(AudioKernels, ScaleMatchesTheCodecLoop) {
+    auto pcm = AllSamples();
+    std::vector<int32_t> output(pcm.size());
+    for (int volume : {0, 1, 37, 70, 99, 100}) {
+        int32_t gain = VolumeToGain(volume);
+        ScalePcm16ToPcm32(pcm.data(), pcm.size(), gain, output.data());
+        for (size_t i = 0; i < pcm.size(); i++) {
+            ASSERT_EQ(output[i], int64_t(pcm[i]) * gain) << "volume " << volume;
+        }
+    }
+    // Full scale at full volume does not saturate in 32 bits
+    const int16_t extremes[] = {INT16_MIN, INT16_MAX};
+    ScalePcm16ToPcm32(extremes, 2, VolumeToGain(100), output.data());
+    EXPECT_EQ(output[0], ReferenceScale(INT16_MIN, 100));
+    EXPECT_EQ(output[1], ReferenceScale(INT16_MAX, 100));
+}
+
+TEST(AudioKernels, ConvertMatchesTheCodecLoopAtAnyAlignment) {
+    std::vector<int32_t> input(1001);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = int32_t(uint32_t(i) * 2654435761u);
+    }
+    input[0] = INT32_MIN;
+    input[1] = INT32_MAX;
+    // One spare sample so the output can start off a word boundary
+    std::vector<int16_t> buffer(input.size() + 1);
+    for (int shift : {12, 16}) {
+        for (size_t offset : {0, 1}) {
+            for (size_t count : {input.size(), input.size() - 1, size_t(1)}) {
+                std::fill(buffer.begin(), buffer.end(), 0x5555);
+                ConvertPcm32ToPcm16(input.data(), count, shift, buffer.data() + offset);
+                for (size_t i = 0; i < count; i++) {
+                    ASSERT_EQ(buffer[offset + i], ReferenceConvert(input[i], shift))
+                        << "shift " << shift << " offset " << offset << " count " << count << " at " << i;
+                }
+                // Nothing past the end is touched
+                if (offset + count < buffer.size()) {
+                    ASSERT_EQ(buffer[offset + count], 0x5555);
+                }
+            }
+        }
+    }
+}
+
+TEST(AudioKernels, GainSaturates) {
+    auto pcm = AllSamples();
+    for (int32_t gain : {0, 1, AUDIO_GAIN_UNITY / 3, AUDIO_GAIN_UNITY, 3 * AUDIO_GAIN_UNITY / 2, 2 * AUDIO_GAIN_UNITY}) {
+        auto output = pcm;
+        ApplyGainPcm16(output.data(), output.size(), gain);
+        for (size_t i = 0; i < pcm.size(); i++) {
+            int32_t expected = std::clamp<int32_t>((int32_t(pcm[i]) * gain) >> 15, INT16_MIN, INT16_MAX);
+            ASSERT_EQ(output[i], expected) << "gain " << gain << " sample " << pcm[i];
+        }
+    }
+}
+
+TEST(AudioKernels, GainIsClampedToTwice) {
+    std::vector<int16_t> pcm = {1000, -1000, 20000};
+    auto negative = pcm;
+    ApplyGainPcm16(negative.data(), negative.size(), -AUDIO_GAIN_UNITY);
+    EXPECT_EQ(negative, std::vector<int16_t>({0, 0, 0}));
+    auto large = pcm;
+    ApplyGainPcm16(large.data(), large.size(), 10 * AUDIO_GAIN_UNITY);
+    EXPECT_EQ(large, std::vector<int16_t>({2000, -2000, INT16_MAX}));
+}
+
+TEST(AudioKernels, SoftClipIsTransparentBelowTheKnee) {
+    std::vector<int32_t> input;
+    for (int32_t sample = -SOFT_CLIP_KNEE; sample <= SOFT_CLIP_KNEE; sample++) {
+        input.push_back(sample);
+    }
+    std::vector<int16_t> output(input.size());
+    SoftClipToPcm16(input.data(), input.size(), output.data());
+    for (size_t i = 0; i < input.size(); i++) {
+        ASSERT_EQ(output[i], input[i]);
+    }
+}
+
+TEST(AudioKernels, SoftClipIsMonotonicAndSymmetric) {
+    // The range of a sum of up to four full scale voices
+    std::vector<int32_t> input;
+    for (int32_t sample = SOFT_CLIP_KNEE; sample <= 4 * 32768; sample += 7) {
+        input.push_back(sample);
+        input.push_back(-sample);
+    }
+    std::vector<int16_t> output(input.size());
+    SoftClipToPcm16(input.data(), input.size(), output.data());
+    int16_t last = SOFT_CLIP_KNEE;
+    for (size_t i = 0; i < input.size(); i += 2) {
+        ASSERT_GE(output[i], last) << "at " << input[i];
+        ASSERT_LT(output[i], INT16_MAX) << "at " << input[i];
+        ASSERT_EQ(output[i + 1], -output[i]) << "at " << input[i];
+        // Compresses, never amplifies
+        ASSERT_LE(output[i], input[i]);
+        last = output[i];
+    }
+    // Continuous at the knee: one step above it moves the output by at most one
+    int32_t near_knee[] = {SOFT_CLIP_KNEE + 1, SOFT_CLIP_KNEE + 2};
+    int16_t near_output[2];
+    SoftClipToPcm16(near_knee, 2, near_output);
+    EXPECT_LE(near_output[0] - SOFT_CLIP_KNEE, 1);
+    EXPECT_LE(near_output[1] - near_output[0], 1);
+}
+
+TEST(AudioKernels, NarrowStopsAtTheFirstOverflow) {
+    std::vector<int32_t> input = {INT16_MIN, -1, 0, INT16_MAX, 12345};
+    std::vector<int16_t> output(input.size());
+    EXPECT_TRUE(NarrowToPcm16(input.data(), input.size(), output.data()));
+    EXPECT_EQ(output, std::vector<int16_t>({INT16_MIN, -1, 0, INT16_MAX, 12345}));
+
+    input[3] = INT16_MAX + 1;
+    EXPECT_FALSE(NarrowToPcm16(input.data(), input.size(), output.data()));
+    input[3] = INT16_MIN - 1;
+    EXPECT_FALSE(NarrowToPcm16(input.data(), input.size(), output.data()));
+}
+
+TEST(AudioKernels, MixAtConstantGain) {
+    auto pcm = AllSamples();
+    std::vector<int32_t> accumulator(pcm.size(), 100);
+    MixWithGainRamp(pcm.data(), pcm.size(), AUDIO_GAIN_UNITY, AUDIO_GAIN_UNITY, accumulator.data());
+    for (size_t i = 0; i < pcm.size(); i++) {
+        ASSERT_EQ(accumulator[i], 100 + pcm[i]);
+    }
+    std::fill(accumulator.begin(), accumulator.end(), 0);
+    MixWithGainRamp(pcm.data(), pcm.size(), AUDIO_GAIN_UNITY / 4, AUDIO_GAIN_UNITY / 4, accumulator.data());
+    for (size_t i = 0; i < pcm.size(); i++) {
+        ASSERT_EQ(accumulator[i], (int32_t(pcm[i]) * (AUDIO_GAIN_UNITY / 4)) >> 15);
+    }
+}
+
+TEST(AudioKernels, MixRampsLinearly) {
+    const size_t samples = 1440;
+    std::vector<int16_t> pcm(samples, 16384);
+    for (auto [start, end] : {std::pair{0, AUDIO_GAIN_UNITY}, std::pair{AUDIO_GAIN_UNITY, AUDIO_GAIN_UNITY / 4}}) {
+        std::vector<int32_t> accumulator(samples, 0);
+        MixWithGainRamp(pcm.data(), samples, start, end, accumulator.data());
+        // Starts at gain_start and stops one step short of gain_end, which the next frame starts at
+        EXPECT_EQ(accumulator.front(), (16384 * start) >> 15);
+        double step = double(end - start) / samples;
+        for (size_t i = 0; i < samples; i++) {
+            double expected = 16384.0 * (start + step * i) / AUDIO_GAIN_UNITY;
+            // The gain and the product are truncated, and the truncated Q23 step lags behind by
+            // up to samples / 256 Q15 steps at the end of the frame
+            ASSERT_NEAR(accumulator[i], expected, 1.0 + 0.5 * (1.0 + i / 256.0)) << "at " << i;
+        }
+    }
+}
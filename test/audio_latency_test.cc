@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include "audio_latency.h"
+
+TEST(LatencyHistogram, BucketBounds) {
+    LatencyHistogram histogram;
+    histogram.Add(2000);    // An upper bound belongs to its bucket
+    histogram.Add(2001);
+    histogram.Add(-500);    // Clock steps are counted as 0
+    histogram.Add(5000000);
+    EXPECT_EQ(histogram.count(), 4u);
+    EXPECT_EQ(histogram.bucket(0), 2u);
+    EXPECT_EQ(histogram.bucket(1), 1u);
+    EXPECT_EQ(histogram.bucket(LATENCY_HISTOGRAM_BUCKETS - 1), 1u);
+    EXPECT_EQ(histogram.max_ms(), 5000);
+    EXPECT_EQ(histogram.average_ms(), (2000 + 2001 + 0 + 5000000) / 4 / 1000);
+}
+
+TEST(LatencyHistogram, Percentiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.PercentileMs(50), 0);
+
+    // 90 frames of 3 ms, 9 of 40 ms, 1 of 700 ms
+    for (int i = 0; i < 90; i++) {
+        histogram.Add(3000);
+    }
+    for (int i = 0; i < 9; i++) {
+        histogram.Add(40000);
+    }
+    histogram.Add(700000);
+    EXPECT_EQ(histogram.PercentileMs(50), 5);
+    EXPECT_EQ(histogram.PercentileMs(90), 5);
+    EXPECT_EQ(histogram.PercentileMs(91), 50);
+    EXPECT_EQ(histogram.PercentileMs(99), 50);
+    // The bucket bound is capped by the largest value seen
+    EXPECT_EQ(histogram.PercentileMs(100), 700);
+}
+
+TEST(LatencyHistogram, PercentileBeyondTheLastBound) {
+    LatencyHistogram histogram;
+    histogram.Add(1500);
+    histogram.Add(2500000);
+    EXPECT_EQ(histogram.PercentileMs(50), 2);
+    EXPECT_EQ(histogram.PercentileMs(99), 2500);
+}
+
+TEST(LatencyHistogram, Reset) {
+    LatencyHistogram histogram;
+    histogram.Add(30000);
+    histogram.Reset();
+    EXPECT_EQ(histogram.count(), 0u);
+    EXPECT_EQ(histogram.max_ms(), 0);
+    EXPECT_EQ(histogram.average_ms(), 0);
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        EXPECT_EQ(histogram.bucket(i), 0u);
+    }
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "audio_mixer.h"
+#include "audio_kernels.h"
+
+static std::vector<int16_t> FullScale(size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = i % 3 == 0 ? INT16_MAX : (i % 3 == 1 ? INT16_MIN : int16_t(i * 97));
+    }
+    return pcm;
+}
+
+TEST(AudioMixer, SingleVoiceAtUnityIsBitExact) {
+    AudioMixer mixer(2, 1000);
+    auto pcm = FullScale(1500);
+    std::vector<int16_t> played;
+    std::vector<int16_t> output;
+    // Chunks of odd sizes, so the ring wraps inside a chunk
+    size_t written = 0;
+    while (written < pcm.size()) {
+        written += mixer.Write(0, pcm.data() + written, std::min<size_t>(333, pcm.size() - written));
+        size_t samples = mixer.Mix(output);
+        played.insert(played.end(), output.begin(), output.begin() + samples);
+    }
+    EXPECT_EQ(played, pcm);
+}
+
+TEST(AudioMixer, MixWithinRangeIsNotCompressed) {
+    std::vector<int16_t> output;
+    AudioMixer mixer(2, 480);
+    std::vector<int16_t> a(480, 20000);
+    std::vector<int16_t> b(480, 12000);
+    mixer.Write(0, a.data(), a.size());
+    mixer.Write(1, b.data(), b.size());
+    mixer.SetGain(1, 0.5f);
+    // The gain ramps over the first chunk, the second is at the target
+    mixer.Mix(output);
+    mixer.Write(0, a.data(), a.size());
+    mixer.Write(1, b.data(), b.size());
+    ASSERT_EQ(mixer.Mix(output), 480u);
+    for (auto sample : output) {
+        ASSERT_EQ(sample, 26000);
+    }
+}
+
+TEST(AudioMixer, OverflowIsSoftClipped) {
+    std::vector<int16_t> output;
+    AudioMixer mixer(2, 480);
+    std::vector<int16_t> a(480, 30000);
+    mixer.Write(0, a.data(), a.size());
+    mixer.Write(1, a.data(), a.size());
+    ASSERT_EQ(mixer.Mix(output), 480u);
+    for (auto sample : output) {
+        ASSERT_GT(sample, SOFT_CLIP_KNEE);
+        ASSERT_LT(sample, INT16_MAX);
+    }
+}
+
+TEST(AudioMixer, DuckedVoiceIsMixed) {
+    std::vector<int16_t> output;
+    AudioMixer mixer(2, 480);
+    mixer.SetPriority(1, 1);
+    mixer.SetDucking(0.25f);
+    std::vector<int16_t> music(480, 8000);
+    std::vector<int16_t> voice(480, 1000);
+    for (int i = 0; i < 2; i++) {
+        mixer.Write(0, music.data(), music.size());
+        mixer.Write(1, voice.data(), voice.size());
+        ASSERT_EQ(mixer.Mix(output), 480u);
+    }
+    EXPECT_EQ(output.back(), 8000 / 4 + 1000);
+}
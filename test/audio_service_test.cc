@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_service.h"
+#include "codecs/wav_file_audio_codec.h"
+
+using namespace std::chrono_literals;
+
+static constexpr int kSampleRate = 16000;
+static constexpr size_t kFrameSamples = kSampleRate * OPUS_FRAME_DURATION_MS / 1000;
+
+static void WriteWav(const std::string& path, const std::vector<int16_t>& pcm) {
+    uint32_t data_size = pcm.size() * sizeof(int16_t);
+    uint32_t riff_size = 36 + data_size;
+    uint32_t fmt_size = 16;
+    uint16_t format = 1, channels = 1, block_align = 2, bits = 16;
+    uint32_t sample_rate = kSampleRate, byte_rate = kSampleRate * 2;
+
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riff_size, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(&fmt_size, 4, 1, file);
+    fwrite(&format, 2, 1, file);
+    fwrite(&channels, 2, 1, file);
+    fwrite(&sample_rate, 4, 1, file);
+    fwrite(&byte_rate, 4, 1, file);
+    fwrite(&block_align, 2, 1, file);
+    fwrite(&bits, 2, 1, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&data_size, 4, 1, file);
+    fwrite(pcm.data(), sizeof(int16_t), pcm.size(), file);
+    fclose(file);
+}
+
+// The samples of the data chunk, as written by WavFileAudioCodec
+static std::vector<int16_t> ReadWav(const std::string& path, int& sample_rate) {
+    std::vector<int16_t> pcm;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return pcm;
+    }
+    char header[44];
+    if (fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, "RIFF", 4) == 0 &&
+        memcmp(header + 36, "data", 4) == 0) {
+        uint32_t data_size;
+        memcpy(&sample_rate, header + 24, 4);
+        memcpy(&data_size, header + 40, 4);
+        pcm.resize(data_size / sizeof(int16_t));
+        pcm.resize(fread(pcm.data(), sizeof(int16_t), pcm.size(), file));
+    }
+    fclose(file);
+    return pcm;
+}
+
+// A sweep, so the delay of the codec shows as one correlation peak
+static std::vector<int16_t> Chirp(size_t samples, double start_hz, double end_hz) {
+    std::vector<int16_t> pcm(samples);
+    double phase = 0;
+    for (size_t i = 0; i < samples; i++) {
+        double hz = start_hz + (end_hz - start_hz) * i / samples;
+        phase += 2 * M_PI * hz / kSampleRate;
+        pcm[i] = 8000 * sin(phase);
+    }
+    return pcm;
+}
+
+// Normalized correlation of output[lag...] with input, over count samples
+static double Correlation(const std::vector<int16_t>& input, const std::vector<int16_t>& output, size_t lag, size_t count) {
+    double xy = 0, xx = 0, yy = 0;
+    for (size_t i = 0; i < count; i++) {
+        double x = input[i];
+        double y = output[i + lag];
+        xy += x * y;
+        xx += x * x;
+        yy += y * y;
+    }
+    return xx > 0 && yy > 0 ? xy / sqrt(xx * yy) : 0;
+}
+
+/*
+ * WAV in -> NoAudioProcessor -> Opus encoder -> send queue, then every uplink packet is handed back
+ * as a downlink packet, like an echo server: jitter buffer -> Opus decoder -> mixer -> WAV out.
+ * With libopus the output is the input delayed by the codec, with the stand-in codec it is the
+ * input at a lower resolution, so both are compared by correlation.
+ */
+TEST(AudioService, WavLoopback) {
+    std::string input_path = testing::TempDir() + "audio_service_input.wav";
+    std::string output_path = testing::TempDir() + "audio_service_output.wav";
+    const size_t frames = 20;
+    auto input = Chirp(frames * kFrameSamples, 150, 500);
+    WriteWav(input_path, input);
+
+    {
+        // Paced at four times real time, so the send queue doesn't back up and the uplink keeps its bitrate
+        WavFileAudioCodec codec(input_path.c_str(), output_path.c_str(), kSampleRate, 4.0f);
+        AudioService service;
+        service.Initialize(&codec);
+        service.Start();
+        service.EnableVoiceProcessing(true);
+
+        size_t looped = 0;
+        auto deadline = std::chrono::steady_clock::now() + 10s;
+        while (looped < frames && std::chrono::steady_clock::now() < deadline) {
+            auto packet = service.PopPacketFromSendQueue();
+            if (!packet) {
+                std::this_thread::sleep_for(1ms);
+                continue;
+            }
+            EXPECT_EQ(packet->sample_rate, kSampleRate);
+            EXPECT_EQ(packet->frame_duration, OPUS_FRAME_DURATION_MS);
+            EXPECT_GT(packet->times.encoded, 0);
+
+            // The transport header room is not part of the downlink packet
+            auto downlink = AudioStreamPacketPool::GetInstance().Acquire();
+            downlink->sample_rate = packet->sample_rate;
+            downlink->frame_duration = packet->frame_duration;
+            downlink->payload.assign(packet->opus_data(), packet->opus_data() + packet->opus_size());
+            ASSERT_TRUE(service.PushPacketToDecodeQueue(std::move(downlink), true));
+            looped++;
+        }
+        ASSERT_EQ(looped, frames);
+        service.EnableVoiceProcessing(false);
+
+        while (!service.IsIdle() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(5ms);
+        }
+        // The output task may still be mixing the last frame
+        std::this_thread::sleep_for(200ms);
+
+        auto json = service.GetLatencyStatsJson();
+        EXPECT_NE(json.find("\"downlink_decode\":{\"count\":" + std::to_string(frames) + ","), std::string::npos) << json;
+
+        service.Stop();
+        // The tasks are detached, give them time to see the stop before the service goes away
+        std::this_thread::sleep_for(100ms);
+    }
+
+    int sample_rate = 0;
+    auto output = ReadWav(output_path, sample_rate);
+    EXPECT_EQ(sample_rate, kSampleRate);
+    ASSERT_EQ(output.size(), input.size());
+
+    // The codec delay is well below one frame, the last frame is left out for the shift
+    size_t count = input.size() - kFrameSamples;
+    size_t best_lag = 0;
+    double best = -1;
+    for (size_t lag = 0; lag < kFrameSamples; lag++) {
+        double correlation = Correlation(input, output, lag, count);
+        if (correlation > best) {
+            best = correlation;
+            best_lag = lag;
+        }
+    }
+    EXPECT_GT(best, 0.9) << "lag " << best_lag;
+
+    remove(input_path.c_str());
+    remove(output_path.c_str());
+}
@@ -0,0 +1,122 @@
+/*
+ * Cost of the codec sample loops per 60 ms frame, against the per-sample loops NoAudioCodec
+ * had before: Write() scaled by a float volume factor with a 64-bit multiply and clamp into a
+ * vector allocated per frame, Read() shifted and clamped each 32-bit slot the same way.
+ *
+ *   audio_kernels_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "audio_kernels.h"
+
+// Output at 24 kHz, input at 16 kHz, like the NoAudioCodec boards
+#define OUTPUT_SAMPLES (24000 * 60 / 1000)
+#define INPUT_SAMPLES (16000 * 60 / 1000)
+#define VOLUME 70
+
+static std::vector<int16_t> MakePcm16(size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = int16_t((i * 7919) % 60000 - 30000);
+    }
+    return pcm;
+}
+
+static std::vector<int32_t> MakePcm32(size_t samples) {
+    std::vector<int32_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = int32_t(uint32_t(i) * 2654435761u);
+    }
+    return pcm;
+}
+
+static void BM_WriteScaleLegacy(benchmark::State& state) {
+    auto data = MakePcm16(OUTPUT_SAMPLES);
+    for (auto _ : state) {
+        std::vector<int32_t> buffer(OUTPUT_SAMPLES);
+        int32_t volume_factor = pow(double(VOLUME) / 100.0, 2) * 65536;
+        for (int i = 0; i < OUTPUT_SAMPLES; i++) {
+            int64_t temp = int64_t(data[i]) * volume_factor;
+            if (temp > INT32_MAX) {
+                buffer[i] = INT32_MAX;
+            } else if (temp < INT32_MIN) {
+                buffer[i] = INT32_MIN;
+            } else {
+                buffer[i] = static_cast<int32_t>(temp);
+            }
+        }
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+
+static void BM_WriteScale(benchmark::State& state) {
+    auto data = MakePcm16(OUTPUT_SAMPLES);
+    std::vector<int32_t> buffer(OUTPUT_SAMPLES);
+    for (auto _ : state) {
+        ScalePcm16ToPcm32(data.data(), OUTPUT_SAMPLES, VolumeToGain(VOLUME), buffer.data());
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+
+static void BM_ReadConvertLegacy(benchmark::State& state) {
+    auto input = MakePcm32(INPUT_SAMPLES);
+    std::vector<int16_t> dest(INPUT_SAMPLES);
+    for (auto _ : state) {
+        std::vector<int32_t> bit32_buffer(input);
+        for (int i = 0; i < INPUT_SAMPLES; i++) {
+            int32_t value = bit32_buffer[i] >> 12;
+            dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+        }
+        benchmark::DoNotOptimize(dest.data());
+    }
+}
+
+static void BM_ReadConvert(benchmark::State& state) {
+    auto input = MakePcm32(INPUT_SAMPLES);
+    std::vector<int32_t> read_buffer(INPUT_SAMPLES);
+    std::vector<int16_t> dest(INPUT_SAMPLES + 1);
+    // state.range(0) = 1 writes to an odd address, the per-sample fallback
+    int16_t* output = dest.data() + state.range(0);
+    for (auto _ : state) {
+        // The legacy loop copies the I2S data too, keep the comparison fair
+        std::copy(input.begin(), input.end(), read_buffer.begin());
+        ConvertPcm32ToPcm16(read_buffer.data(), INPUT_SAMPLES, 12, output);
+        benchmark::DoNotOptimize(output);
+    }
+}
+
+static void BM_ApplyGain(benchmark::State& state) {
+    auto pcm = MakePcm16(OUTPUT_SAMPLES);
+    int32_t gain = AUDIO_GAIN_UNITY * 3 / 2;
+    for (auto _ : state) {
+        ApplyGainPcm16(pcm.data(), OUTPUT_SAMPLES, gain);
+        benchmark::DoNotOptimize(pcm.data());
+        // Flip between boost and cut so the samples don't all end up saturated
+        gain = AUDIO_GAIN_UNITY * 2 - gain + AUDIO_GAIN_UNITY / 2;
+    }
+}
+
+// state.range(0) is the peak of the sum, in percent of 16-bit full scale
+static void BM_SoftClip(benchmark::State& state) {
+    std::vector<int32_t> sum(OUTPUT_SAMPLES);
+    int32_t peak = int64_t(INT16_MAX) * state.range(0) / 100;
+    for (size_t i = 0; i < sum.size(); i++) {
+        sum[i] = int32_t((int64_t(i) * 7919) % (2 * peak + 1) - peak);
+    }
+    std::vector<int16_t> output(OUTPUT_SAMPLES);
+    for (auto _ : state) {
+        SoftClipToPcm16(sum.data(), OUTPUT_SAMPLES, output.data());
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+
+BENCHMARK(BM_WriteScaleLegacy);
+BENCHMARK(BM_WriteScale);
+BENCHMARK(BM_ReadConvertLegacy);
+BENCHMARK(BM_ReadConvert)->ArgName("odd")->Arg(0)->Arg(1);
+BENCHMARK(BM_ApplyGain);
+BENCHMARK(BM_SoftClip)->ArgName("peak%")->Arg(50)->Arg(200);
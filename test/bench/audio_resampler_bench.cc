@@ -0,0 +1,37 @@
+/*
+ * CPU time of the polyphase resamplers per 60 ms frame, for the sample rate pairs of the boards.
+ * The taps counter is the number of multiply-accumulates per output sample.
+ *
+ *   audio_resampler_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "audio_resampler.h"
+
+#define FRAME_DURATION_MS 60
+
+template <int Up, int Down>
+static void BM_PolyphaseResampler(benchmark::State& state) {
+    int input_rate = 8000 * state.range(0);
+    PolyphaseResampler<Up, Down> resampler;
+    std::vector<int16_t> input(input_rate * FRAME_DURATION_MS / 1000);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = int16_t(i * 7919);
+    }
+    std::vector<int16_t> output(input.size() * Up / Down + 1);
+    for (auto _ : state) {
+        resampler.Process(input.data(), input.size(), output.data());
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["taps"] = PolyphaseResampler<Up, Down>::kTaps;
+}
+
+// The argument is the input rate in units of 8 kHz
+BENCHMARK_TEMPLATE(BM_PolyphaseResampler, 1, 3)->Name("48000_to_16000")->Arg(6);
+BENCHMARK_TEMPLATE(BM_PolyphaseResampler, 2, 3)->Name("24000_to_16000")->Arg(3);
+BENCHMARK_TEMPLATE(BM_PolyphaseResampler, 1, 2)->Name("48000_to_24000")->Arg(6);
+BENCHMARK_TEMPLATE(BM_PolyphaseResampler, 3, 2)->Name("16000_to_24000")->Arg(2);
+BENCHMARK_TEMPLATE(BM_PolyphaseResampler, 3, 1)->Name("16000_to_48000")->Arg(2);
+BENCHMARK_TEMPLATE(BM_PolyphaseResampler, 2, 1)->Name("24000_to_48000")->Arg(3);
@@ -0,0 +1,163 @@
+/*
+ * Per-packet cost of getting one encoded uplink packet onto the websocket, for protocol versions
+ * 1, 2 and 3, from the encoder output to the buffer handed to the socket.
+ *
+ * Legacy: the encoder wrote into a scratch buffer that was copied into the pooled packet, and
+ * SendAudio allocated a string for the header and copied the payload behind it.
+ * Headroom: the encoder writes behind AUDIO_STREAM_PACKET_HEADROOM and SendAudio fills the header
+ * in place with PrependHeader(). The framing is the one of WebsocketProtocol::SendAudio, which
+ * itself needs the board and can't be built on the host.
+ *
+ * The socket copies the frame into its send buffer, like the TLS record layer does, in both cases.
+ * state.range(0) is the version, state.range(1) the Opus packet size (60 ms at 8, 16 and 32 kbps).
+ * Counter allocs_per_packet counts the heap allocations, which cost far more on the device heap
+ * than on the host.
+ *
+ *   audio_send_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "protocol.h"
+
+static size_t allocations = 0;
+
+// The replaced operator new allocates with malloc, GCC can't tell the pair matches
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static uint8_t socket_buffer[2048];
+
+static bool SocketSend(const void* data, size_t len) {
+    memcpy(socket_buffer, data, len);
+    benchmark::DoNotOptimize(socket_buffer);
+    return true;
+}
+
+// The encoder output, written into the buffer at offset
+static void Encode(std::vector<uint8_t>& opus, size_t offset, size_t size) {
+    opus.resize(offset + size);
+    memset(opus.data() + offset, 0x5A, size);
+}
+
+static bool SendLegacy(int version, AudioStreamPacket* packet) {
+    if (version == 2) {
+        std::string serialized;
+        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet->timestamp);
+        bp2->payload_size = htonl(packet->payload.size());
+        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
+        return SocketSend(serialized.data(), serialized.size());
+    } else if (version == 3) {
+        std::string serialized;
+        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet->payload.size());
+        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+        return SocketSend(serialized.data(), serialized.size());
+    }
+    return SocketSend(packet->payload.data(), packet->payload.size());
+}
+
+static bool SendHeadroom(int version, AudioStreamPacket* packet) {
+    if (version == 2) {
+        auto bp2 = (BinaryProtocol2*)packet->PrependHeader(sizeof(BinaryProtocol2));
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet->timestamp);
+        bp2->payload_size = htonl(packet->opus_size());
+        return SocketSend(bp2, sizeof(BinaryProtocol2) + packet->opus_size());
+    } else if (version == 3) {
+        auto bp3 = (BinaryProtocol3*)packet->PrependHeader(sizeof(BinaryProtocol3));
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet->opus_size());
+        return SocketSend(bp3, sizeof(BinaryProtocol3) + packet->opus_size());
+    }
+    return SocketSend(packet->opus_data(), packet->opus_size());
+}
+
+static void BM_SendLegacy(benchmark::State& state) {
+    int version = state.range(0);
+    size_t size = state.range(1);
+    std::vector<uint8_t> encode_buffer;
+    size_t start = allocations;
+    for (auto _ : state) {
+        auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+        packet->timestamp = 1234;
+        Encode(encode_buffer, 0, size);
+        packet->payload.assign(encode_buffer.begin(), encode_buffer.end());
+        benchmark::DoNotOptimize(SendLegacy(version, packet.get()));
+    }
+    state.counters["allocs_per_packet"] = double(allocations - start) / state.iterations();
+}
+
+static void BM_SendHeadroom(benchmark::State& state) {
+    int version = state.range(0);
+    size_t size = state.range(1);
+    size_t start = allocations;
+    for (auto _ : state) {
+        auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+        packet->timestamp = 1234;
+        packet->headroom = AUDIO_STREAM_PACKET_HEADROOM;
+        packet->payload.resize(packet->headroom);
+        Encode(packet->payload, packet->headroom, size);
+        benchmark::DoNotOptimize(SendHeadroom(version, packet.get()));
+    }
+    state.counters["allocs_per_packet"] = double(allocations - start) / state.iterations();
+}
+
+// Packets without headroom, like the wake word pre-roll, are shifted once
+static void BM_SendNoHeadroom(benchmark::State& state) {
+    int version = state.range(0);
+    size_t size = state.range(1);
+    size_t start = allocations;
+    for (auto _ : state) {
+        auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+        packet->timestamp = 1234;
+        Encode(packet->payload, 0, size);
+        benchmark::DoNotOptimize(SendHeadroom(version, packet.get()));
+    }
+    state.counters["allocs_per_packet"] = double(allocations - start) / state.iterations();
+}
+
+static void SendArgs(benchmark::internal::Benchmark* bench) {
+    bench->ArgNames({"version", "bytes"});
+    for (int version = 1; version <= 3; version++) {
+        for (int bytes : {60, 120, 240}) {
+            bench->Args({version, bytes});
+        }
+    }
+}
+
+BENCHMARK(BM_SendLegacy)->Apply(SendArgs);
+BENCHMARK(BM_SendHeadroom)->Apply(SendArgs);
+BENCHMARK(BM_SendNoHeadroom)->ArgNames({"version", "bytes"})->Args({2, 120})->Args({3, 120});
@@ -0,0 +1,160 @@
+/*
+ * Dispatching the text messages of a server session: the ControlMessage tokenizer and the perfect
+ * hash lookup of the type, replayed over the transcript in data/control_transcript.jsonl.
+ *
+ * The transcript is built from the message examples in docs/websocket.md and docs/mqtt-udp.md
+ * (hello, stt, llm, tts sentences, mcp, alert, system, goodbye, some lines escaped the way
+ * ensure_ascii servers send them), it is not a capture of a live server. One iteration replays
+ * the whole transcript, items/s is messages per second. The cJSON path the other types fall back
+ * to needs the real cJSON, which the host build doesn't have, so it is not measured here.
+ *
+ * Counter allocs_per_message counts the heap allocations of the dispatch, counted by the operator
+ * new of this binary. BM_Lookup* compare the type lookup with the strcmp chain it replaced.
+ *
+ *   control_message_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "control_message.h"
+#include "protocol.h"
+
+static size_t allocations = 0;
+
+// The replaced operator new allocates with malloc, GCC can't tell the pair matches
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const std::vector<std::string>& Transcript() {
+    static std::vector<std::string> lines = [] {
+        std::vector<std::string> lines;
+        std::ifstream file(TEST_DATA_DIR "/control_transcript.jsonl");
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+        }
+        return lines;
+    }();
+    return lines;
+}
+
+class TranscriptProtocol : public Protocol {
+public:
+    using Protocol::DispatchControlMessage;
+
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override { return true; }
+    void CloseAudioChannel() override {}
+    bool IsAudioChannelOpened() const override { return true; }
+    bool SendAudio(AudioStreamPacketPtr packet) override { return true; }
+
+protected:
+    bool SendText(const std::string& text) override { return true; }
+};
+
+// The type names as the dispatch in Application compared them before the lookup table
+static ControlMessageType LookupStrcmp(const char* type) {
+    if (strcmp(type, "tts") == 0) {
+        return kControlMessageTts;
+    } else if (strcmp(type, "stt") == 0) {
+        return kControlMessageStt;
+    } else if (strcmp(type, "llm") == 0) {
+        return kControlMessageLlm;
+    } else if (strcmp(type, "mcp") == 0) {
+        return kControlMessageMcp;
+    } else if (strcmp(type, "system") == 0) {
+        return kControlMessageSystem;
+    } else if (strcmp(type, "alert") == 0) {
+        return kControlMessageAlert;
+    } else if (strcmp(type, "custom") == 0) {
+        return kControlMessageCustom;
+    } else if (strcmp(type, "hello") == 0) {
+        return kControlMessageHello;
+    } else if (strcmp(type, "goodbye") == 0) {
+        return kControlMessageGoodbye;
+    }
+    return kControlMessageUnknown;
+}
+
+static const char* kTypeNames[] = {"tts", "stt", "llm", "tts", "tts", "mcp", "alert", "goodbye", "iot"};
+
+static void BM_DispatchTranscript(benchmark::State& state) {
+    auto& transcript = Transcript();
+    TranscriptProtocol protocol;
+    size_t dispatched = 0;
+    protocol.OnIncomingMessage([&](const ControlMessage& message) {
+        benchmark::DoNotOptimize(message.GetString("text"));
+        dispatched++;
+    });
+    size_t start = allocations;
+    for (auto _ : state) {
+        for (auto& line : transcript) {
+            benchmark::DoNotOptimize(protocol.DispatchControlMessage(line.data(), line.size()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * transcript.size());
+    state.counters["allocs_per_message"] = double(allocations - start) / (state.iterations() * transcript.size());
+    state.counters["fast_path"] = double(dispatched) / (state.iterations() * transcript.size());
+}
+
+// The tokenizer alone, on a copy of each message as the receive buffer would hold it
+static void BM_ParseTranscript(benchmark::State& state) {
+    auto& transcript = Transcript();
+    char buffer[CONTROL_MESSAGE_ARENA_SIZE];
+    ControlMessage message;
+    for (auto _ : state) {
+        for (auto& line : transcript) {
+            memcpy(buffer, line.data(), line.size());
+            benchmark::DoNotOptimize(message.Parse(buffer, line.size()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * transcript.size());
+}
+
+static void BM_LookupStrcmp(benchmark::State& state) {
+    for (auto _ : state) {
+        for (auto name : kTypeNames) {
+            benchmark::DoNotOptimize(name);
+            benchmark::DoNotOptimize(LookupStrcmp(name));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * std::size(kTypeNames));
+}
+
+static void BM_LookupTable(benchmark::State& state) {
+    for (auto _ : state) {
+        for (auto name : kTypeNames) {
+            benchmark::DoNotOptimize(name);
+            benchmark::DoNotOptimize(LookupControlMessageType(name));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * std::size(kTypeNames));
+}
+
+BENCHMARK(BM_DispatchTranscript);
+BENCHMARK(BM_ParseTranscript);
+BENCHMARK(BM_LookupStrcmp);
+BENCHMARK(BM_LookupTable);
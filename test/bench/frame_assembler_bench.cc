@@ -0,0 +1,61 @@
+/*
+ * Cutting the AFE output into uplink frames: FrameAssembler against the vector AfeAudioProcessor
+ * appended each fetch to, copying a frame out and erasing it from the front. One iteration is one
+ * AFE fetch of 512 samples at 16 kHz, state.range(0) is the frame duration in ms.
+ *
+ *   frame_assembler_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "frame_assembler.h"
+
+#define FETCH_SAMPLES 512
+
+static std::vector<int16_t> MakeFetch() {
+    std::vector<int16_t> fetch(FETCH_SAMPLES);
+    for (size_t i = 0; i < fetch.size(); i++) {
+        fetch[i] = int16_t(i * 31);
+    }
+    return fetch;
+}
+
+static void BM_VectorErase(benchmark::State& state) {
+    size_t frame_samples = 16 * state.range(0);
+    auto fetch = MakeFetch();
+    std::vector<int16_t> output_buffer;
+    output_buffer.reserve(frame_samples);
+    for (auto _ : state) {
+        output_buffer.insert(output_buffer.end(), fetch.data(), fetch.data() + fetch.size());
+        while (output_buffer.size() >= frame_samples) {
+            if (output_buffer.size() == frame_samples) {
+                std::vector<int16_t> frame(std::move(output_buffer));
+                benchmark::DoNotOptimize(frame.data());
+                output_buffer.clear();
+                output_buffer.reserve(frame_samples);
+            } else {
+                std::vector<int16_t> frame(output_buffer.begin(), output_buffer.begin() + frame_samples);
+                benchmark::DoNotOptimize(frame.data());
+                output_buffer.erase(output_buffer.begin(), output_buffer.begin() + frame_samples);
+            }
+        }
+    }
+}
+
+// The frames go to a pooled task buffer, the one copy the processor output needs
+static void BM_FrameAssembler(benchmark::State& state) {
+    size_t frame_samples = 16 * state.range(0);
+    auto fetch = MakeFetch();
+    FrameAssembler assembler(frame_samples);
+    std::vector<int16_t> task_pcm(frame_samples);
+    for (auto _ : state) {
+        assembler.Push(fetch.data(), fetch.size(), [&](const int16_t* data, size_t samples) {
+            std::copy(data, data + samples, task_pcm.begin());
+            benchmark::DoNotOptimize(task_pcm.data());
+        });
+    }
+}
+
+BENCHMARK(BM_VectorErase)->ArgName("frame_ms")->Arg(20)->Arg(60);
+BENCHMARK(BM_FrameAssembler)->ArgName("frame_ms")->Arg(20)->Arg(60);
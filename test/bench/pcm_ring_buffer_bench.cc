@@ -0,0 +1,114 @@
+/*
+ * Storing the wake word pre-roll while listening: the fixed PcmRingBuffer against the deque of
+ * vectors AfeWakeWord and CustomWakeWord kept before, one 30 ms AFE fetch (512 samples at 16 kHz)
+ * per iteration, about 2 s retained.
+ *
+ * Counter allocs_per_fetch is the number of heap allocations per stored fetch, counted by the
+ * operator new of this binary. BM_Frames* time handing the 60 ms frames of a full pre-roll to
+ * the encoder.
+ *
+ *   pcm_ring_buffer_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <vector>
+
+#include "pcm_ring_buffer.h"
+
+#define FETCH_SAMPLES 512
+#define PREROLL_MS 2000
+#define FRAME_SAMPLES (16000 * 60 / 1000)
+
+static size_t allocations = 0;
+
+// The replaced operator new allocates with malloc, GCC can't tell the pair matches
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static std::vector<int16_t> MakeFetch() {
+    std::vector<int16_t> fetch(FETCH_SAMPLES);
+    for (size_t i = 0; i < fetch.size(); i++) {
+        fetch[i] = int16_t(i * 31);
+    }
+    return fetch;
+}
+
+static void BM_StoreDeque(benchmark::State& state) {
+    auto fetch = MakeFetch();
+    std::deque<std::vector<int16_t>> wake_word_pcm;
+    size_t start = allocations;
+    for (auto _ : state) {
+        wake_word_pcm.emplace_back(std::vector<int16_t>(fetch.data(), fetch.data() + fetch.size()));
+        while (wake_word_pcm.size() > PREROLL_MS / 30) {
+            wake_word_pcm.pop_front();
+        }
+    }
+    state.counters["allocs_per_fetch"] = double(allocations - start) / state.iterations();
+}
+
+static void BM_StoreRing(benchmark::State& state) {
+    auto fetch = MakeFetch();
+    PcmRingBuffer ring(16000 * PREROLL_MS / 1000);
+    size_t start = allocations;
+    for (auto _ : state) {
+        ring.Write(fetch.data(), fetch.size());
+    }
+    state.counters["allocs_per_fetch"] = double(allocations - start) / state.iterations();
+}
+
+// Walking the frames of a full pre-roll, as the wake word encoder does before encoding them
+static void BM_FramesDeque(benchmark::State& state) {
+    auto fetch = MakeFetch();
+    std::deque<std::vector<int16_t>> wake_word_pcm;
+    for (int i = 0; i < PREROLL_MS / 30; i++) {
+        wake_word_pcm.emplace_back(fetch);
+    }
+    for (auto _ : state) {
+        // The old encoder wrapper gathered the chunks into a buffer and cut frames from its front
+        std::vector<int16_t> buffer;
+        for (auto& pcm : wake_word_pcm) {
+            buffer.insert(buffer.end(), pcm.begin(), pcm.end());
+            while (buffer.size() >= FRAME_SAMPLES) {
+                benchmark::DoNotOptimize(buffer.data());
+                buffer.erase(buffer.begin(), buffer.begin() + FRAME_SAMPLES);
+            }
+        }
+    }
+}
+
+static void BM_FramesRing(benchmark::State& state) {
+    auto fetch = MakeFetch();
+    PcmRingBuffer ring(16000 * PREROLL_MS / 1000);
+    for (int i = 0; i < PREROLL_MS / 30 + 1; i++) {
+        ring.Write(fetch.data(), fetch.size());
+    }
+    std::vector<int16_t> scratch(FRAME_SAMPLES);
+    for (auto _ : state) {
+        ring.ForEachFrame(FRAME_SAMPLES, scratch.data(), [](const int16_t* frame) {
+            benchmark::DoNotOptimize(frame);
+        });
+    }
+}
+
+BENCHMARK(BM_StoreDeque);
+BENCHMARK(BM_StoreRing);
+BENCHMARK(BM_FramesDeque)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FramesRing)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,69 @@
+/*
+ * Cost of resampling one read of a two-channel codec (mic + AEC reference) to 16 kHz,
+ * with the former temporary vectors vs. ResampleStereo() in place through a reused scratch buffer.
+ *
+ *   resample_stereo_bench --benchmark_filter=48000
+ */
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "audio_kernels.h"
+
+#define READ_DURATION_MS 60
+
+static std::vector<int16_t> MakeRead(int sample_rate) {
+    std::vector<int16_t> data(2 * sample_rate * READ_DURATION_MS / 1000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = int16_t(i * 7919);
+    }
+    return data;
+}
+
+static void BM_ResampleStereoVectors(benchmark::State& state) {
+    int sample_rate = state.range(0);
+    auto input_resampler = CreateAudioResampler(sample_rate, 16000);
+    auto reference_resampler = CreateAudioResampler(sample_rate, 16000);
+    auto read = MakeRead(sample_rate);
+    std::vector<int16_t> data;
+    for (auto _ : state) {
+        data = read;
+        auto mic_channel = std::vector<int16_t>(data.size() / 2);
+        auto reference_channel = std::vector<int16_t>(data.size() / 2);
+        for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+            mic_channel[i] = data[j];
+            reference_channel[i] = data[j + 1];
+        }
+        auto resampled_mic = std::vector<int16_t>(input_resampler->GetOutputSamples(mic_channel.size()));
+        auto resampled_reference = std::vector<int16_t>(reference_resampler->GetOutputSamples(reference_channel.size()));
+        input_resampler->Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
+        reference_resampler->Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
+        data.resize(resampled_mic.size() + resampled_reference.size());
+        for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+            data[j] = resampled_mic[i];
+            data[j + 1] = resampled_reference[i];
+        }
+        benchmark::DoNotOptimize(data.data());
+    }
+}
+
+static void BM_ResampleStereoInPlace(benchmark::State& state) {
+    int sample_rate = state.range(0);
+    auto input_resampler = CreateAudioResampler(sample_rate, 16000);
+    auto reference_resampler = CreateAudioResampler(sample_rate, 16000);
+    auto read = MakeRead(sample_rate);
+    std::vector<int16_t> data;
+    std::vector<int16_t> scratch;
+    for (auto _ : state) {
+        data = read;
+        size_t frames = data.size() / 2;
+        size_t output_frames = input_resampler->GetOutputSamples(frames);
+        scratch.resize(GetResampleStereoScratchSamples(frames, output_frames));
+        ResampleStereo(*input_resampler, *reference_resampler, data.data(), frames, data.data(), scratch.data());
+        data.resize(output_frames * 2);
+        benchmark::DoNotOptimize(data.data());
+    }
+}
+
+BENCHMARK(BM_ResampleStereoVectors)->Arg(24000)->Arg(48000);
+BENCHMARK(BM_ResampleStereoInPlace)->Arg(24000)->Arg(48000);
@@ -0,0 +1,175 @@
+/*
+ * Jitter of the AudioService tasks with the lock-free SPSC rings vs. the former shared queue lock.
+ *
+ * spsc_queue_bench runs AudioService as it is. spsc_queue_locked_bench is the same benchmark with
+ * audio_service.cc built against bench/locked_queue.h: deques behind one mutex shared by all
+ * queues, and every change wakes every waiting task, like audio_queue_mutex_ / audio_queue_cv_.
+ *
+ * The service runs in full duplex in real time: BenchCodec delivers one mic frame per frame
+ * duration and plays the speaker like a blocking I2S write, the bench thread is the network. It
+ * sends the uplink packets and returns them as downlink packets in bursts, like TTS. With the
+ * stand-in codec of shim/opus the codec task does almost no work, build with libopus for the
+ * encode and decode load of the device.
+ *
+ * Counters (microseconds): input_late_* is how far behind the mic AudioInputTask reads a frame,
+ * output_late_* how far behind the speaker AudioOutputTask writes one, and uplink_* the time
+ * from the capture of a frame until the network pops its packet from the send queue.
+ *
+ *   spsc_queue_bench && spsc_queue_locked_bench
+ */
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <esp_timer.h>
+
+#include "audio_codec.h"
+#include "audio_service.h"
+
+#define DOWNLINK_BURST 8
+#define RUN_TIME_MS 3000
+#define SAMPLE_RATE 16000
+// Longer gaps are pauses of the stream, not late frames
+#define MAX_LATE_US (100 * 1000)
+
+#ifdef SPSC_QUEUE_BASELINE
+#define QUEUES_LABEL "locked deques"
+#else
+#define QUEUES_LABEL "spsc rings"
+#endif
+
+static void SleepUntil(int64_t due) {
+    int64_t wait = due - esp_timer_get_time();
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    }
+}
+
+// Mic and speaker on the sample clock. Each vector is written by one task, and read after the service has stopped
+class BenchCodec : public AudioCodec {
+public:
+    std::vector<int64_t> input_late;
+    std::vector<int64_t> output_late;
+
+    BenchCodec() {
+        duplex_ = true;
+        input_sample_rate_ = SAMPLE_RATE;
+        output_sample_rate_ = SAMPLE_RATE;
+        tone_.resize(SAMPLE_RATE / 100);
+        for (size_t i = 0; i < tone_.size(); i++) {
+            tone_[i] = 4000 * sin(2 * M_PI * 400 * i / SAMPLE_RATE);
+        }
+    }
+
+private:
+    std::vector<int16_t> tone_;
+    int64_t input_start_ = 0;
+    int64_t input_samples_ = 0;
+    int64_t output_start_ = 0;
+    int64_t output_samples_ = 0;
+
+    // Returns when the mic has captured the samples
+    int Read(int16_t* dest, int samples) override {
+        int64_t now = esp_timer_get_time();
+        int64_t due = input_start_ + (input_samples_ + samples) * 1000000 / SAMPLE_RATE;
+        if (input_samples_ == 0 || now - due > MAX_LATE_US) {
+            input_start_ = now;
+            input_samples_ = 0;
+            due = now + samples * 1000000LL / SAMPLE_RATE;
+        } else {
+            input_late.push_back(std::max<int64_t>(0, now - due));
+        }
+        for (int i = 0; i < samples; i++) {
+            dest[i] = tone_[(input_samples_ + i) % tone_.size()];
+        }
+        input_samples_ += samples;
+        SleepUntil(due);
+        return samples;
+    }
+
+    // Returns when the samples before have been played, the speaker underruns if the next write comes later
+    int Write(const int16_t* data, int samples) override {
+        int64_t now = esp_timer_get_time();
+        int64_t due = output_start_ + output_samples_ * 1000000 / SAMPLE_RATE;
+        if (output_samples_ == 0 || now - due > MAX_LATE_US) {
+            output_start_ = now;
+            output_samples_ = 0;
+            due = now;
+        } else {
+            output_late.push_back(std::max<int64_t>(0, now - due));
+        }
+        output_samples_ += samples;
+        SleepUntil(due);
+        return samples;
+    }
+};
+
+static int64_t Percentile(std::vector<int64_t> values, int percentile) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * percentile / 100];
+}
+
+static void Report(benchmark::State& state, const char* name, const std::vector<int64_t>& values) {
+    state.counters[std::string(name) + "_p50"] = Percentile(values, 50);
+    state.counters[std::string(name) + "_p99"] = Percentile(values, 99);
+    state.counters[std::string(name) + "_max"] = Percentile(values, 100);
+}
+
+static void BM_AudioServiceJitter(benchmark::State& state) {
+    int frame_ms = state.range(0);
+    for (auto _ : state) {
+        BenchCodec codec;
+        std::vector<int64_t> uplink;
+        {
+            AudioService service;
+            service.Initialize(&codec);
+            service.Start();
+            service.SetUplinkFrameDuration(frame_ms);
+            service.EnableVoiceProcessing(true);
+
+            std::vector<AudioStreamPacketPtr> burst;
+            int64_t deadline = esp_timer_get_time() + RUN_TIME_MS * 1000LL;
+            while (esp_timer_get_time() < deadline) {
+                auto packet = service.PopPacketFromSendQueue();
+                if (!packet) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                uplink.push_back(packet->times.dequeued - packet->times.captured);
+                service.RecordAudioSent(packet->times);
+
+                auto downlink = AudioStreamPacketPool::GetInstance().Acquire();
+                downlink->sample_rate = packet->sample_rate;
+                downlink->frame_duration = packet->frame_duration;
+                downlink->payload.assign(packet->opus_data(), packet->opus_data() + packet->opus_size());
+                burst.push_back(std::move(downlink));
+                if (burst.size() == DOWNLINK_BURST) {
+                    for (auto& downlink : burst) {
+                        service.PushPacketToDecodeQueue(std::move(downlink), true);
+                    }
+                    burst.clear();
+                }
+            }
+
+            service.EnableVoiceProcessing(false);
+            service.Stop();
+            // The tasks are detached, give them time to see the stop before the service goes away
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        Report(state, "input_late", codec.input_late);
+        Report(state, "output_late", codec.output_late);
+        Report(state, "uplink", uplink);
+    }
+    state.SetLabel(QUEUES_LABEL);
+}
+
+BENCHMARK(BM_AudioServiceJitter)->Arg(60)->Arg(20)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "control_message.h"
+#include "protocol.h"
+
+static std::vector<std::string> LoadTranscript(const char* name) {
+    std::ifstream file(std::string(TEST_DATA_DIR) + "/" + name);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+// Parses a copy, the views point into it
+struct ParsedMessage {
+    std::string buffer;
+    ControlMessage message;
+    bool valid;
+
+    explicit ParsedMessage(std::string json) : buffer(std::move(json)) {
+        valid = message.Parse(buffer.data(), buffer.size());
+    }
+};
+
+TEST(ControlMessage, LookupKnowsEveryType) {
+    EXPECT_EQ(LookupControlMessageType("hello"), kControlMessageHello);
+    EXPECT_EQ(LookupControlMessageType("goodbye"), kControlMessageGoodbye);
+    EXPECT_EQ(LookupControlMessageType("tts"), kControlMessageTts);
+    EXPECT_EQ(LookupControlMessageType("stt"), kControlMessageStt);
+    EXPECT_EQ(LookupControlMessageType("llm"), kControlMessageLlm);
+    EXPECT_EQ(LookupControlMessageType("mcp"), kControlMessageMcp);
+    EXPECT_EQ(LookupControlMessageType("system"), kControlMessageSystem);
+    EXPECT_EQ(LookupControlMessageType("alert"), kControlMessageAlert);
+    EXPECT_EQ(LookupControlMessageType("custom"), kControlMessageCustom);
+}
+
+TEST(ControlMessage, LookupRejectsOtherNames) {
+    // Same slot or prefix as a known type, other case, too short
+    for (const char* name : {"", "t", "tt", "ttss", "tts ", "TTS", "hell", "helloo", "sst", "mcpx", "iot", "listen"}) {
+        EXPECT_EQ(LookupControlMessageType(name), kControlMessageUnknown) << name;
+    }
+}
+
+TEST(ControlMessage, ParsesTopLevelFields) {
+    ParsedMessage parsed(R"( {"session_id" : "abc", "type":"tts" ,"state":"sentence_start","text":"你好"} )");
+    ASSERT_TRUE(parsed.valid);
+    EXPECT_EQ(parsed.message.type(), kControlMessageTts);
+    EXPECT_EQ(parsed.message.GetString("session_id"), "abc");
+    EXPECT_EQ(parsed.message.GetString("state"), "sentence_start");
+    EXPECT_EQ(parsed.message.GetString("text"), "你好");
+    EXPECT_EQ(parsed.message.GetString("emotion"), std::nullopt);
+}
+
+TEST(ControlMessage, NonStringValuesAreSkipped) {
+    ParsedMessage parsed(R"({"type":"hello","version":3,"ok":true,"none":null,)"
+                         R"("audio_params":{"format":"opus","tags":["a}","b]"],"rate":24000},"transport":"udp"})");
+    ASSERT_TRUE(parsed.valid);
+    EXPECT_EQ(parsed.message.type(), kControlMessageHello);
+    EXPECT_EQ(parsed.message.GetString("version"), std::nullopt);
+    EXPECT_EQ(parsed.message.GetString("audio_params"), std::nullopt);
+    // Brackets in nested strings don't end the object
+    EXPECT_EQ(parsed.message.GetString("transport"), "udp");
+}
+
+TEST(ControlMessage, UnescapesInPlace) {
+    ParsedMessage parsed(R"({"type":"stt","text":"a\"b\\c\/d\n\t\r\b\f"})");
+    ASSERT_TRUE(parsed.valid);
+    EXPECT_EQ(parsed.message.GetString("text"), "a\"b\\c/d\n\t\r\b\f");
+    EXPECT_GE(parsed.message.GetString("text")->data(), parsed.buffer.data());
+}
+
+TEST(ControlMessage, UnicodeEscapesBecomeUtf8) {
+    // ensure_ascii servers send everything outside ASCII escaped, emoji as surrogate pairs
+    ParsedMessage parsed(R"({"type":"llm","emotion":"happy","text":"A\u00e9\u4f60\u597D\ud83d\ude00"})");
+    ASSERT_TRUE(parsed.valid);
+    EXPECT_EQ(parsed.message.GetString("text"), "Aé你好😀");
+}
+
+TEST(ControlMessage, EscapedTypeIsLookedUp) {
+    ParsedMessage parsed(R"({"type":"\u0074ts","state":"stop"})");
+    ASSERT_TRUE(parsed.valid);
+    EXPECT_EQ(parsed.message.type(), kControlMessageTts);
+}
+
+TEST(ControlMessage, UnknownTypeIsValid) {
+    ParsedMessage parsed(R"({"type":"iot","commands":[]})");
+    ASSERT_TRUE(parsed.valid);
+    EXPECT_EQ(parsed.message.type(), kControlMessageUnknown);
+}
+
+TEST(ControlMessage, RejectsInvalidMessages) {
+    const char* invalid[] = {
+        "",
+        "[]",
+        "{}",
+        R"({"text":"no type"})",
+        R"({"type":3})",
+        R"({"type":"tts")",
+        R"({"type":"tts",})",
+        R"({"type" "tts"})",
+        R"({"type":"tts" "state":"stop"})",
+        R"({type:"tts"})",
+        R"({"type":"tts","text":"unterminated})",
+        R"({"type":"tts","text":"bad \x escape"})",
+        R"({"type":"tts","text":"\u12"})",
+        R"({"type":"tts","text":"\u12g4"})",
+        R"({"type":"tts","text":"\ud83d"})",
+        R"({"type":"tts","text":"\ud83dA"})",
+        R"({"type":"tts","text":"\ude00"})",
+        R"({"type":"tts","payload":{"a":"b"})",
+        R"({"type":"tts","payload":})",
+        "{\"type\":\"tts\",\"text\":\"raw\nnewline\"}",
+    };
+    for (const char* json : invalid) {
+        ParsedMessage parsed(json);
+        EXPECT_FALSE(parsed.valid) << json;
+        EXPECT_EQ(parsed.message.type(), kControlMessageUnknown) << json;
+    }
+}
+
+TEST(ControlMessage, FieldLimit) {
+    std::string json = R"({"type":"tts")";
+    for (int i = 1; i < CONTROL_MESSAGE_MAX_FIELDS; i++) {
+        json += ",\"f" + std::to_string(i) + "\":\"x\"";
+    }
+    EXPECT_TRUE(ParsedMessage(json + "}").valid);
+    EXPECT_FALSE(ParsedMessage(json + ",\"one_more\":\"x\"}").valid);
+}
+
+TEST(ControlMessage, ReparseForgetsThePreviousMessage) {
+    ControlMessage message;
+    std::string first = R"({"type":"tts","state":"start"})";
+    std::string second = R"({"type":"stt","text":"hi"})";
+    ASSERT_TRUE(message.Parse(first.data(), first.size()));
+    ASSERT_TRUE(message.Parse(second.data(), second.size()));
+    EXPECT_EQ(message.type(), kControlMessageStt);
+    EXPECT_EQ(message.GetString("state"), std::nullopt);
+}
+
+// Every line of the transcript parses, with the type and text a cJSON parse would give
+TEST(ControlMessage, TranscriptParses) {
+    auto transcript = LoadTranscript("control_transcript.jsonl");
+    ASSERT_FALSE(transcript.empty());
+    for (auto& line : transcript) {
+        ParsedMessage parsed(line);
+        ASSERT_TRUE(parsed.valid) << line;
+        EXPECT_NE(parsed.message.type(), kControlMessageUnknown) << line;
+        EXPECT_EQ(parsed.message.GetString("session_id"), "9f3c2a10") << line;
+    }
+    ParsedMessage joke(transcript[21]);
+    EXPECT_EQ(joke.message.GetString("text"), "爸爸说：\"因为鱼在里面哭。\"\n哈哈！");
+}
+
+class TranscriptProtocol : public Protocol {
+public:
+    using Protocol::DispatchControlMessage;
+
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override { return true; }
+    void CloseAudioChannel() override {}
+    bool IsAudioChannelOpened() const override { return true; }
+    bool SendAudio(AudioStreamPacketPtr packet) override { return true; }
+
+protected:
+    bool SendText(const std::string& text) override { return true; }
+};
+
+// Only tts, stt and llm take the fast path, everything else falls back to cJSON
+TEST(ControlMessage, DispatchReplaysTheTranscript) {
+    TranscriptProtocol protocol;
+    std::vector<ControlMessageType> dispatched;
+    std::vector<std::string> texts;
+    protocol.OnIncomingMessage([&](const ControlMessage& message) {
+        dispatched.push_back(message.type());
+        texts.emplace_back(message.GetString("text").value_or(""));
+    });
+
+    int fallbacks = 0;
+    for (auto& line : LoadTranscript("control_transcript.jsonl")) {
+        ParsedMessage parsed(line);
+        bool fast = parsed.message.type() == kControlMessageTts || parsed.message.type() == kControlMessageStt ||
+                    parsed.message.type() == kControlMessageLlm;
+        EXPECT_EQ(protocol.DispatchControlMessage(line.data(), line.size()), fast) << line;
+        fallbacks += !fast;
+    }
+    EXPECT_EQ(dispatched.size(), 23u);
+    EXPECT_EQ(fallbacks, 6);
+    EXPECT_EQ(texts[0], "今天天气怎么样");
+    EXPECT_EQ(texts[1], "😀");
+    EXPECT_EQ(texts.back(), "关机，再见 👋");
+}
+
+TEST(ControlMessage, DispatchLeavesLongAndInvalidMessagesToCJson) {
+    TranscriptProtocol protocol;
+    int dispatched = 0;
+    protocol.OnIncomingMessage([&](const ControlMessage&) { dispatched++; });
+
+    std::string invalid = R"({"type":"tts","state":)";
+    EXPECT_FALSE(protocol.DispatchControlMessage(invalid.data(), invalid.size()));
+    std::string text(CONTROL_MESSAGE_ARENA_SIZE, 'x');
+    std::string longest = R"({"type":"tts","text":")" + text + "\"}";
+    EXPECT_FALSE(protocol.DispatchControlMessage(longest.data(), longest.size()));
+    EXPECT_EQ(dispatched, 0);
+
+    // The arena is reused, the input is not modified
+    std::string escaped = R"({"type":"stt","text":"\u4f60"})";
+    std::string copy = escaped;
+    EXPECT_TRUE(protocol.DispatchControlMessage(escaped.data(), escaped.size()));
+    EXPECT_EQ(escaped, copy);
+    EXPECT_EQ(dispatched, 1);
+}
+
+TEST(ControlMessage, DispatchWithoutCallbackFallsBack) {
+    TranscriptProtocol protocol;
+    std::string stt = R"({"type":"stt","text":"hi"})";
+    EXPECT_FALSE(protocol.DispatchControlMessage(stt.data(), stt.size()));
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "frame_assembler.h"
+
+static std::vector<int16_t> Ramp(size_t samples, int16_t start = 0) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = int16_t(start + i);
+    }
+    return pcm;
+}
+
+// Chunks of random sizes, as the AFE fetches and codec reads come in
+TEST(FrameAssembler, FramesFollowTheStream) {
+    const size_t frame = 960;
+    FrameAssembler assembler(frame);
+    auto stream = Ramp(100000);
+    std::vector<int16_t> output;
+    std::mt19937 random(1);
+    size_t offset = 0;
+    int frames = 0;
+    while (offset < stream.size()) {
+        size_t chunk = std::min<size_t>(random() % 3000, stream.size() - offset);
+        frames += assembler.Push(stream.data() + offset, chunk, [&](const int16_t* data, size_t samples) {
+            ASSERT_EQ(samples, frame);
+            output.insert(output.end(), data, data + samples);
+        });
+        offset += chunk;
+        ASSERT_EQ(assembler.pending(), offset % frame);
+    }
+    EXPECT_EQ(frames, int(stream.size() / frame));
+    EXPECT_EQ(output, std::vector<int16_t>(stream.begin(), stream.begin() + frames * frame));
+}
+
+TEST(FrameAssembler, AlignedFramesArePassedInPlace) {
+    FrameAssembler assembler(480);
+    auto chunk = Ramp(480 * 3);
+    std::vector<const int16_t*> frames;
+    assembler.Push(chunk.data(), chunk.size(), [&](const int16_t* data, size_t samples) {
+        frames.push_back(data);
+    });
+    EXPECT_EQ(frames, std::vector<const int16_t*>({chunk.data(), chunk.data() + 480, chunk.data() + 960}));
+}
+
+TEST(FrameAssembler, FramesAcrossFetchesAreAssembled) {
+    // 512 sample fetches into 960 sample frames: no frame lies within a fetch
+    FrameAssembler assembler(960);
+    std::vector<int16_t> stream;
+    std::vector<int16_t> output;
+    for (int i = 0; i < 15; i++) {
+        auto fetch = Ramp(512, int16_t(i * 512));
+        assembler.Push(fetch.data(), fetch.size(), [&](const int16_t* data, size_t samples) {
+            // Views of the fetch would point into it, an assembled frame into the assembler
+            EXPECT_TRUE(data < fetch.data() || data >= fetch.data() + fetch.size());
+            output.insert(output.end(), data, data + samples);
+        });
+        stream.insert(stream.end(), fetch.begin(), fetch.end());
+    }
+    ASSERT_EQ(output.size(), 960u * 8);
+    EXPECT_EQ(output, std::vector<int16_t>(stream.begin(), stream.begin() + output.size()));
+    EXPECT_EQ(assembler.pending(), 15u * 512 - 8 * 960);
+}
+
+TEST(FrameAssembler, StrideTakesOneChannel) {
+    // Interleaved stereo, the left channel counts up and the right one down
+    std::vector<int16_t> stereo;
+    for (int i = 0; i < 1000; i++) {
+        stereo.push_back(i);
+        stereo.push_back(-i);
+    }
+    FrameAssembler assembler(160);
+    std::vector<int16_t> left;
+    // Odd chunk sizes, so a chunk can end between the two samples of a frame
+    for (size_t offset = 0; offset < stereo.size(); offset += 2 * 77) {
+        size_t chunk = std::min<size_t>(2 * 77, stereo.size() - offset);
+        assembler.Push(stereo.data() + offset, chunk, [&](const int16_t* data, size_t samples) {
+            left.insert(left.end(), data, data + samples);
+        }, 2);
+    }
+    EXPECT_EQ(left, Ramp(960));
+    EXPECT_EQ(assembler.pending(), 1000u - 960);
+}
+
+TEST(FrameAssembler, SetFrameSamplesDropsThePending) {
+    FrameAssembler assembler(100);
+    auto pcm = Ramp(250);
+    EXPECT_EQ(assembler.Push(pcm.data(), pcm.size(), [](const int16_t*, size_t) {}), 2);
+    EXPECT_EQ(assembler.pending(), 50u);
+
+    assembler.SetFrameSamples(60);
+    EXPECT_EQ(assembler.pending(), 0u);
+    std::vector<int16_t> output;
+    assembler.Push(pcm.data(), 60, [&](const int16_t* data, size_t samples) {
+        output.assign(data, data + samples);
+    });
+    EXPECT_EQ(output, Ramp(60));
+}
+
+TEST(FrameAssembler, NoFrameSizeNoFrames) {
+    FrameAssembler assembler;
+    auto pcm = Ramp(100);
+    EXPECT_EQ(assembler.Push(pcm.data(), pcm.size(), [](const int16_t*, size_t) { FAIL(); }), 0);
+    EXPECT_EQ(assembler.pending(), 0u);
+}
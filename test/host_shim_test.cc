@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#include "host_shim.h"
+
+TEST(HostShim, FrozenClock) {
+    HostClockFreeze(1000);
+    EXPECT_EQ(esp_timer_get_time(), 1000);
+    HostClockAdvance(500);
+    EXPECT_EQ(esp_timer_get_time(), 1500);
+    HostClockRelease();
+}
+
+TEST(HostShim, TaskNotification) {
+    static std::atomic<TaskHandle_t> waiter = nullptr;
+    waiter = xTaskGetCurrentTaskHandle();
+    xTaskCreate([](void* arg) {
+        xTaskNotifyGive(waiter);
+        vTaskDelete(NULL);
+    }, "notifier", 4096, nullptr, 1, nullptr);
+    EXPECT_EQ(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)), 1u);
+    EXPECT_EQ(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10)), 0u);
+}
+
+TEST(HostShim, EventGroup) {
+    auto group = xEventGroupCreate();
+    xEventGroupSetBits(group, 0x3);
+    EXPECT_EQ(xEventGroupWaitBits(group, 0x1, pdTRUE, pdFALSE, 0), 0x3u);
+    EXPECT_EQ(xEventGroupGetBits(group), 0x2u);
+    EXPECT_EQ(xEventGroupWaitBits(group, 0x5, pdFALSE, pdTRUE, 10) & 0x5, 0x0u);
+    vEventGroupDelete(group);
+}
+
+TEST(HostShim, OneShotTimer) {
+    static std::atomic<TaskHandle_t> waiter = nullptr;
+    static std::atomic<int> calls = 0;
+    waiter = xTaskGetCurrentTaskHandle();
+    esp_timer_create_args_t args = {
+        .callback = [](void* arg) {
+            calls++;
+            xTaskNotifyGive(waiter);
+        },
+        .arg = nullptr,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "one_shot",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t timer = nullptr;
+    ASSERT_EQ(esp_timer_create(&args, &timer), ESP_OK);
+
+    ASSERT_EQ(esp_timer_start_once(timer, 5000), ESP_OK);
+    EXPECT_EQ(esp_timer_start_once(timer, 5000), ESP_ERR_INVALID_STATE);
+    EXPECT_EQ(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)), 1u);
+    EXPECT_EQ(esp_timer_stop(timer), ESP_ERR_INVALID_STATE);
+
+    // A stopped timer does not fire
+    ASSERT_EQ(esp_timer_start_once(timer, 20000), ESP_OK);
+    EXPECT_EQ(esp_timer_stop(timer), ESP_OK);
+    EXPECT_EQ(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50)), 0u);
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(esp_timer_delete(timer), ESP_OK);
+}
+
+TEST(HostShim, JsonPrint) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* list = cJSON_CreateArray();
+    cJSON_AddItemToArray(list, cJSON_CreateNumber(1));
+    cJSON_AddItemToArray(list, cJSON_CreateNumber(2.5));
+    cJSON_AddItemToObject(root, "list", list);
+    cJSON_AddBoolToObject(root, "on", true);
+    cJSON_AddStringToObject(root, "text", "a \"b\"\n");
+    char* json = cJSON_PrintUnformatted(root);
+    EXPECT_EQ(std::string(json), "{\"list\":[1,2.5],\"on\":true,\"text\":\"a \\\"b\\\"\\u000a\"}");
+    cJSON_free(json);
+    cJSON_Delete(root);
+}
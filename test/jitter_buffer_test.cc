@@ -0,0 +1,342 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <esp_timer.h>
+
+#include "jitter_buffer.h"
+#include "host_shim.h"
+
+#define FRAME_MS 60
+#define REORDER_WINDOW_MS 60
+
+class JitterBufferTest : public ::testing::Test {
+protected:
+    JitterBuffer buffer_{32, 2400};
+
+    void SetUp() override {
+        HostClockFreeze(1000000);
+    }
+
+    void TearDown() override {
+        HostClockRelease();
+    }
+
+    // A packet of the MQTT/UDP transport if sequence >= 0, a websocket packet otherwise
+    static AudioStreamPacketPtr MakePacket(int64_t sequence) {
+        auto packet = AudioStreamPacketPtr(new AudioStreamPacket());
+        packet->frame_duration = FRAME_MS;
+        packet->payload.assign(10, uint8_t(sequence));
+        if (sequence >= 0) {
+            packet->sequence = sequence;
+            packet->has_sequence = true;
+        }
+        return packet;
+    }
+
+    void Push(int64_t sequence) {
+        ASSERT_TRUE(buffer_.Push(MakePacket(sequence)));
+    }
+
+    // Plays the buffer out in real time until it runs dry
+    int PlayOut() {
+        int played = 0;
+        while (true) {
+            AudioStreamPacketPtr packet;
+            int wait_ms = 0;
+            auto result = buffer_.Pop(packet, wait_ms);
+            if (result == kJitterBufferEmpty) {
+                return played;
+            }
+            if (result == kJitterBufferBuffering) {
+                HostClockAdvance(wait_ms * 1000LL);
+                continue;
+            }
+            played++;
+            HostClockAdvance(FRAME_MS * 1000);
+        }
+    }
+
+    // A TTS sentence: a burst of frames, played out, followed by a pause
+    void Sentence(int64_t& sequence, int frames, int pause_ms, bool sequenced) {
+        for (int i = 0; i < frames; i++) {
+            Push(sequenced ? sequence++ : -1);
+        }
+        EXPECT_EQ(PlayOut(), frames);
+        HostClockAdvance(pause_ms * 1000LL);
+    }
+};
+
+TEST_F(JitterBufferTest, SequenceZeroIsARealSequence) {
+    Push(0);
+    Push(2);
+    Push(1);
+    auto statistics = buffer_.GetStatistics();
+    EXPECT_EQ(statistics.received, 3u);
+    EXPECT_EQ(statistics.reordered, 1u);
+    EXPECT_EQ(statistics.duplicate, 0u);
+
+    for (int i = 0; i < 3; i++) {
+        AudioStreamPacketPtr packet;
+        int wait_ms = 0;
+        ASSERT_EQ(buffer_.Pop(packet, wait_ms), kJitterBufferPacket);
+        EXPECT_EQ(packet->payload[0], i);
+    }
+}
+
+TEST_F(JitterBufferTest, WebsocketSentencePausesAreNotUnderruns) {
+    int64_t sequence = 0;
+    for (int i = 0; i < 20; i++) {
+        Sentence(sequence, 10, 300, false);
+    }
+    auto statistics = buffer_.GetStatistics();
+    EXPECT_EQ(statistics.underruns, 0u);
+    EXPECT_EQ(statistics.jitter_ms, 0);
+    EXPECT_EQ(statistics.target_delay_ms, 0);
+}
+
+TEST_F(JitterBufferTest, SequencedUnderrunsGrowTheDelay) {
+    int64_t sequence = 0;
+    for (int i = 0; i < 3; i++) {
+        Sentence(sequence, 10, 300, true);
+    }
+    auto statistics = buffer_.GetStatistics();
+    EXPECT_EQ(statistics.underruns, 2u);
+    EXPECT_GT(statistics.target_delay_ms, 0);
+}
+
+TEST_F(JitterBufferTest, ClearForgetsTheDelay) {
+    int64_t sequence = 0;
+    for (int i = 0; i < 3; i++) {
+        Sentence(sequence, 10, 300, true);
+    }
+    buffer_.Clear();
+    auto statistics = buffer_.GetStatistics();
+    EXPECT_EQ(statistics.jitter_ms, 0);
+    EXPECT_EQ(statistics.target_delay_ms, 0);
+}
+
+struct TracePacket {
+    uint32_t sequence;
+    int64_t arrival_ms;
+};
+
+struct ReplayResult {
+    std::vector<uint32_t> played;
+    std::vector<int64_t> played_ms;
+    int concealed = 0;
+    // Time the decoder waited for a gap between two frames, beyond the frame duration
+    int max_hold_ms = 0;
+    int total_hold_ms = 0;
+    JitterBufferStatistics statistics;
+};
+
+// Replays a packet trace with a reorder window, the decoder pulls a frame every FRAME_MS like
+// AudioService::DecodeNextPacket and is woken by pushes while it waits
+class JitterBufferTraceTest : public JitterBufferTest {
+protected:
+    static std::vector<TracePacket> LoadTrace(const char* name) {
+        std::ifstream file(std::string(TEST_DATA_DIR) + "/" + name);
+        std::vector<TracePacket> trace;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            TracePacket packet;
+            std::istringstream(line) >> packet.sequence >> packet.arrival_ms;
+            trace.push_back(packet);
+        }
+        return trace;
+    }
+
+    ReplayResult Replay(std::vector<TracePacket> trace) {
+        std::stable_sort(trace.begin(), trace.end(), [](const TracePacket& a, const TracePacket& b) {
+            return a.arrival_ms < b.arrival_ms;
+        });
+        JitterBuffer buffer(32, 2400, REORDER_WINDOW_MS);
+        ReplayResult result;
+        int64_t now_ms = 0;
+        int64_t pop_ms = -1;
+        int64_t last_frame_ms = -1;
+        bool waiting = false;
+        size_t next = 0;
+        while (next < trace.size() || pop_ms >= 0) {
+            bool push = next < trace.size() && (pop_ms < 0 || trace[next].arrival_ms <= pop_ms);
+            int64_t event_ms = push ? trace[next].arrival_ms : pop_ms;
+            HostClockAdvance((event_ms - now_ms) * 1000);
+            now_ms = event_ms;
+
+            if (push) {
+                EXPECT_TRUE(buffer.Push(MakePacket(trace[next++].sequence)));
+                if (pop_ms < 0 || waiting) {
+                    pop_ms = now_ms;
+                }
+                continue;
+            }
+
+            AudioStreamPacketPtr packet;
+            int wait_ms = 0;
+            auto popped = buffer.Pop(packet, wait_ms);
+            if (popped == kJitterBufferEmpty) {
+                pop_ms = -1;
+                last_frame_ms = -1;
+                continue;
+            }
+            if (popped == kJitterBufferBuffering) {
+                pop_ms = now_ms + wait_ms;
+                waiting = true;
+                continue;
+            }
+            if (last_frame_ms >= 0) {
+                int hold_ms = now_ms - last_frame_ms - FRAME_MS;
+                result.max_hold_ms = std::max(result.max_hold_ms, hold_ms);
+                result.total_hold_ms += hold_ms;
+            }
+            if (popped == kJitterBufferPacket) {
+                result.played.push_back(packet->sequence);
+                result.played_ms.push_back(now_ms);
+            } else {
+                result.concealed++;
+            }
+            last_frame_ms = now_ms;
+            pop_ms = now_ms + FRAME_MS;
+            waiting = false;
+        }
+        result.statistics = buffer.GetStatistics();
+        return result;
+    }
+
+    static std::vector<uint32_t> Sequences(uint32_t first, uint32_t last, std::vector<uint32_t> except = {}) {
+        std::vector<uint32_t> sequences;
+        for (uint32_t sequence = first; sequence <= last; sequence++) {
+            if (std::find(except.begin(), except.end(), sequence) == except.end()) {
+                sequences.push_back(sequence);
+            }
+        }
+        return sequences;
+    }
+
+    static void Drop(std::vector<TracePacket>& trace, uint32_t sequence) {
+        trace.erase(std::remove_if(trace.begin(), trace.end(), [&](const TracePacket& packet) {
+            return packet.sequence == sequence;
+        }), trace.end());
+    }
+
+    static void Delay(std::vector<TracePacket>& trace, uint32_t sequence, int64_t arrival_ms) {
+        for (auto& packet : trace) {
+            if (packet.sequence == sequence) {
+                packet.arrival_ms = arrival_ms;
+            }
+        }
+    }
+};
+
+TEST_F(JitterBufferTraceTest, TracePlaysInOrderWithoutHolds) {
+    auto trace = LoadTrace("udp_audio_trace.txt");
+    ASSERT_EQ(trace.size(), 300u);
+    auto result = Replay(trace);
+    EXPECT_EQ(result.played, Sequences(0, 299));
+    EXPECT_EQ(result.concealed, 0);
+    EXPECT_EQ(result.total_hold_ms, 0);
+    EXPECT_EQ(result.statistics.lost, 0u);
+    EXPECT_EQ(result.statistics.underruns, 0u);
+}
+
+// Neighbours swapped on the link: the earlier packet arrives behind the later one
+TEST_F(JitterBufferTraceTest, SwappedPacketsAreReordered) {
+    auto trace = LoadTrace("udp_audio_trace.txt");
+    std::vector<uint32_t> swapped = {20, 71, 100, 171, 172, 241, 280};
+    for (auto sequence : swapped) {
+        Delay(trace, sequence, trace[sequence + 1].arrival_ms + 20);
+    }
+    auto result = Replay(trace);
+    EXPECT_EQ(result.played, Sequences(0, 299));
+    EXPECT_EQ(result.concealed, 0);
+    EXPECT_EQ(result.statistics.reordered, swapped.size());
+    EXPECT_EQ(result.statistics.lost, 0u);
+}
+
+// A packet that turns up while its gap is held is played, the hold ends when it arrives
+TEST_F(JitterBufferTraceTest, GapHoldWaitsForTheReorderedPacket) {
+    auto trace = LoadTrace("udp_audio_trace.txt");
+    auto clean = Replay(trace);
+    Delay(trace, 150, clean.played_ms[150] + REORDER_WINDOW_MS / 2);
+    auto result = Replay(trace);
+    EXPECT_EQ(result.played, Sequences(0, 299));
+    EXPECT_EQ(result.concealed, 0);
+    EXPECT_EQ(result.max_hold_ms, REORDER_WINDOW_MS / 2);
+    EXPECT_EQ(result.statistics.late, 0u);
+}
+
+// Past the window the gap is concealed, the packet is dropped as late when it comes
+TEST_F(JitterBufferTraceTest, HoldIsBoundedByTheWindow) {
+    auto trace = LoadTrace("udp_audio_trace.txt");
+    auto clean = Replay(trace);
+    Delay(trace, 150, clean.played_ms[150] + REORDER_WINDOW_MS + 30);
+    auto result = Replay(trace);
+    EXPECT_EQ(result.played, Sequences(0, 299, {150}));
+    EXPECT_EQ(result.concealed, 1);
+    EXPECT_EQ(result.max_hold_ms, REORDER_WINDOW_MS);
+    EXPECT_EQ(result.statistics.late, 1u);
+    EXPECT_EQ(result.statistics.lost, 1u);
+}
+
+// A burst loss is held once, concealed for JITTER_BUFFER_MAX_CONCEAL_FRAMES and skipped after
+TEST_F(JitterBufferTraceTest, BurstLossIsConcealedThenSkipped) {
+    auto trace = LoadTrace("udp_audio_trace.txt");
+    std::vector<uint32_t> dropped = {120, 121, 122, 123, 124};
+    for (auto sequence : dropped) {
+        Drop(trace, sequence);
+    }
+    auto result = Replay(trace);
+    EXPECT_EQ(result.played, Sequences(0, 299, dropped));
+    EXPECT_EQ(result.concealed, JITTER_BUFFER_MAX_CONCEAL_FRAMES);
+    EXPECT_EQ(result.total_hold_ms, REORDER_WINDOW_MS);
+    EXPECT_EQ(result.statistics.lost, dropped.size());
+}
+
+TEST_F(JitterBufferTraceTest, DuplicatesArePlayedOnce) {
+    auto trace = LoadTrace("udp_audio_trace.txt");
+    for (uint32_t sequence : {30, 90, 200}) {
+        trace.push_back({sequence, trace[sequence].arrival_ms + 5});
+    }
+    auto result = Replay(trace);
+    EXPECT_EQ(result.played, Sequences(0, 299));
+    EXPECT_EQ(result.statistics.duplicate, 3u);
+}
+
+// Random reordering, loss and duplicates: playout stays in order, holds stay within the
+// window and every sequence is either played or counted as lost
+TEST_F(JitterBufferTraceTest, RandomDisorderKeepsTheOrder) {
+    auto base = LoadTrace("udp_audio_trace.txt");
+    for (int seed = 1; seed <= 20; seed++) {
+        std::mt19937 random(seed);
+        std::vector<TracePacket> trace;
+        for (auto packet : base) {
+            int dice = random() % 100;
+            if (dice < 5) {
+                packet.arrival_ms += random() % 200;
+            } else if (dice < 7) {
+                continue;
+            } else if (dice < 9) {
+                trace.push_back({packet.sequence, packet.arrival_ms + int64_t(random() % 100)});
+            }
+            trace.push_back(packet);
+        }
+
+        auto result = Replay(trace);
+        ASSERT_FALSE(result.played.empty()) << "seed " << seed;
+        for (size_t i = 1; i < result.played.size(); i++) {
+            ASSERT_GT(result.played[i], result.played[i - 1]) << "seed " << seed;
+        }
+        EXPECT_LE(result.max_hold_ms, REORDER_WINDOW_MS) << "seed " << seed;
+        EXPECT_EQ(result.statistics.received, result.played.size()) << "seed " << seed;
+        EXPECT_EQ(result.played.back() - result.played.front() + 1, result.played.size() + result.statistics.lost)
+            << "seed " << seed;
+    }
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "pcm_ring_buffer.h"
+
+static std::vector<int16_t> Concat(const PcmRingBuffer& ring) {
+    PcmSpan spans[2];
+    int count = ring.GetSpans(spans);
+    std::vector<int16_t> samples;
+    for (int i = 0; i < count; i++) {
+        EXPECT_GT(spans[i].samples, 0u);
+        samples.insert(samples.end(), spans[i].data, spans[i].data + spans[i].samples);
+    }
+    return samples;
+}
+
+TEST(PcmRingBuffer, EmptyHasNoSpans) {
+    PcmRingBuffer ring(100);
+    PcmSpan spans[2];
+    EXPECT_EQ(ring.GetSpans(spans), 0);
+    int16_t scratch[10];
+    EXPECT_EQ(ring.ForEachFrame(10, scratch, [](const int16_t*) { FAIL(); }), 0);
+}
+
+// Random writes, some longer than the ring, against a deque of the newest samples
+TEST(PcmRingBuffer, KeepsTheNewestSamples) {
+    const size_t capacity = 1000;
+    PcmRingBuffer ring(capacity);
+    std::deque<int16_t> expected;
+    std::mt19937 random(1);
+    int16_t next = 0;
+    for (int i = 0; i < 500; i++) {
+        size_t samples = random() % (i % 50 == 0 ? 2500 : 400);
+        std::vector<int16_t> chunk(samples);
+        for (auto& sample : chunk) {
+            sample = next++;
+        }
+        ring.Write(chunk.data(), chunk.size());
+        expected.insert(expected.end(), chunk.begin(), chunk.end());
+        while (expected.size() > capacity) {
+            expected.pop_front();
+        }
+        ASSERT_EQ(ring.size(), expected.size());
+        ASSERT_EQ(Concat(ring), std::vector<int16_t>(expected.begin(), expected.end())) << "write " << i;
+    }
+}
+
+TEST(PcmRingBuffer, ClearStartsOver) {
+    PcmRingBuffer ring(8);
+    int16_t data[] = {1, 2, 3, 4, 5, 6};
+    ring.Write(data, 6);
+    ring.Clear();
+    EXPECT_EQ(ring.size(), 0u);
+    ring.Write(data, 3);
+    EXPECT_EQ(Concat(ring), std::vector<int16_t>({1, 2, 3}));
+}
+
+// The frames the wake word encoder gets: the newest complete frames, in place unless they wrap
+TEST(PcmRingBuffer, ForEachFrameTakesTheNewestFrames) {
+    const size_t capacity = 1000;
+    const size_t frame = 160;
+    PcmRingBuffer ring(capacity);
+    std::vector<int16_t> history;
+    std::mt19937 random(2);
+    for (int i = 0; i < 200; i++) {
+        std::vector<int16_t> chunk(random() % 300 + 1);
+        for (auto& sample : chunk) {
+            sample = int16_t(history.size() + (&sample - chunk.data()));
+        }
+        ring.Write(chunk.data(), chunk.size());
+        history.insert(history.end(), chunk.begin(), chunk.end());
+
+        size_t buffered = std::min(history.size(), capacity);
+        size_t frames = buffered / frame;
+        std::vector<int16_t> scratch(frame, 0);
+        std::vector<int16_t> seen;
+        int copied = 0;
+        int count = ring.ForEachFrame(frame, scratch.data(), [&](const int16_t* data) {
+            if (data == scratch.data()) {
+                copied++;
+            }
+            seen.insert(seen.end(), data, data + frame);
+        });
+        ASSERT_EQ(count, int(frames));
+        ASSERT_LE(copied, 1) << "only the frame that wraps is copied";
+        std::vector<int16_t> newest(history.end() - frames * frame, history.end());
+        ASSERT_EQ(seen, newest) << "write " << i;
+    }
+}
+
+TEST(PcmRingBuffer, FrameAcrossTheEndIsCopied) {
+    PcmRingBuffer ring(10);
+    std::vector<int16_t> data = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+    ring.Write(data.data(), 8);
+    ring.Write(data.data() + 8, 6);
+    // The ring holds 4..13, with 10..13 at the start of the storage
+    int16_t scratch[5] = {};
+    std::vector<std::vector<int16_t>> frames;
+    std::vector<bool> in_scratch;
+    ring.ForEachFrame(5, scratch, [&](const int16_t* frame) {
+        frames.emplace_back(frame, frame + 5);
+        in_scratch.push_back(frame == scratch);
+    });
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0], std::vector<int16_t>({4, 5, 6, 7, 8}));
+    EXPECT_EQ(frames[1], std::vector<int16_t>({9, 10, 11, 12, 13}));
+    EXPECT_FALSE(in_scratch[0]);
+    EXPECT_TRUE(in_scratch[1]);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "audio_kernels.h"
+
+// The two-channel path of ReadAudioData before ResampleStereo(), with its temporary vectors
+static std::vector<int16_t> ResampleStereoReference(AudioResampler& left_resampler, AudioResampler& right_resampler,
+    const std::vector<int16_t>& data) {
+    auto mic_channel = std::vector<int16_t>(data.size() / 2);
+    auto reference_channel = std::vector<int16_t>(data.size() / 2);
+    for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+        mic_channel[i] = data[j];
+        reference_channel[i] = data[j + 1];
+    }
+    auto resampled_mic = std::vector<int16_t>(left_resampler.GetOutputSamples(mic_channel.size()));
+    auto resampled_reference = std::vector<int16_t>(right_resampler.GetOutputSamples(reference_channel.size()));
+    left_resampler.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
+    right_resampler.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
+    std::vector<int16_t> result(resampled_mic.size() + resampled_reference.size());
+    for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+        result[j] = resampled_mic[i];
+        result[j + 1] = resampled_reference[i];
+    }
+    return result;
+}
+
+static std::vector<int16_t> RandomPcm(std::mt19937& rng, size_t samples) {
+    std::uniform_int_distribution<int> distribution(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> pcm(samples);
+    for (auto& sample : pcm) {
+        sample = distribution(rng);
+    }
+    return pcm;
+}
+
+TEST(ResampleStereo, DeinterleaveMatchesScalarAtAnyAlignment) {
+    std::mt19937 rng(1);
+    auto input = RandomPcm(rng, 2 * 101 + 2);
+    for (size_t input_offset = 0; input_offset < 2; input_offset++) {
+        for (size_t output_offset = 0; output_offset < 2; output_offset++) {
+            for (size_t frames : {0, 1, 2, 7, 100, 101}) {
+                std::vector<int16_t> left(frames + 1), right(frames + 1);
+                DeinterleaveStereo(input.data() + input_offset, frames, left.data() + output_offset, right.data() + output_offset);
+                for (size_t i = 0; i < frames; i++) {
+                    ASSERT_EQ(left[output_offset + i], input[input_offset + 2 * i]);
+                    ASSERT_EQ(right[output_offset + i], input[input_offset + 2 * i + 1]);
+                }
+
+                std::vector<int16_t> output(2 * frames + 1);
+                InterleaveStereo(left.data() + output_offset, right.data() + output_offset, frames, output.data() + input_offset);
+                for (size_t i = 0; i < 2 * frames; i++) {
+                    ASSERT_EQ(output[input_offset + i], input[input_offset + i]);
+                }
+            }
+        }
+    }
+}
+
+class ResampleStereoRates : public ::testing::TestWithParam<std::pair<int, int>> {};
+
+// Several reads in a row, so the filter history carried between calls is compared too
+TEST_P(ResampleStereoRates, BitExactWithTheSeparateChannelPath) {
+    auto [input_rate, output_rate] = GetParam();
+    auto left = CreateAudioResampler(input_rate, output_rate);
+    auto right = CreateAudioResampler(input_rate, output_rate);
+    auto reference_left = CreateAudioResampler(input_rate, output_rate);
+    auto reference_right = CreateAudioResampler(input_rate, output_rate);
+    ASSERT_NE(left, nullptr);
+
+    std::mt19937 rng(input_rate + output_rate);
+    std::vector<int16_t> scratch;
+    std::vector<int16_t> data;
+    for (size_t frames : {960, 961, 30, 1, 480, 1441}) {
+        auto input = RandomPcm(rng, 2 * frames);
+        auto expected = ResampleStereoReference(*reference_left, *reference_right, input);
+
+        // In place, like ReadAudioData
+        data = input;
+        size_t output_frames = left->GetOutputSamples(frames);
+        scratch.resize(GetResampleStereoScratchSamples(frames, output_frames));
+        if (output_frames > frames) {
+            data.resize(output_frames * 2);
+        }
+        ASSERT_EQ(ResampleStereo(*left, *right, data.data(), frames, data.data(), scratch.data()), output_frames);
+        data.resize(output_frames * 2);
+        ASSERT_EQ(data, expected) << frames << " frames";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Rates, ResampleStereoRates, ::testing::Values(
+    std::make_pair(48000, 16000), std::make_pair(24000, 16000), std::make_pair(16000, 48000),
+    std::make_pair(44100, 16000)));
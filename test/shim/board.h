@@ -0,0 +1,20 @@
+#ifndef HOST_BOARD_H
+#define HOST_BOARD_H
+
+#include "display.h"
+
+// Stand-in for main/boards/common/board.h, with the part the audio codec base class uses
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board instance;
+        return instance;
+    }
+
+    Display* GetDisplay() { return &display_; }
+
+private:
+    Display display_;
+};
+
+#endif // HOST_BOARD_H
@@ -0,0 +1,45 @@
+#ifndef HOST_CJSON_H
+#define HOST_CJSON_H
+
+/*
+ * The part of cJSON the host build uses: building a tree and printing it. There is no parser,
+ * the structure is laid out like the one of cJSON.
+ */
+
+#define cJSON_False  (1 << 0)
+#define cJSON_True   (1 << 1)
+#define cJSON_NULL   (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array  (1 << 5)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON* next;
+    struct cJSON* prev;
+    struct cJSON* child;
+    int type;
+    char* valuestring;
+    int valueint;
+    double valuedouble;
+    char* string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON* cJSON_CreateObject(void);
+cJSON* cJSON_CreateArray(void);
+cJSON* cJSON_CreateNumber(double number);
+cJSON* cJSON_CreateBool(cJSON_bool boolean);
+cJSON* cJSON_CreateString(const char* string);
+cJSON_bool cJSON_AddItemToObject(cJSON* object, const char* name, cJSON* item);
+cJSON_bool cJSON_AddItemToArray(cJSON* array, cJSON* item);
+cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number);
+cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, cJSON_bool boolean);
+cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string);
+// Free the result with cJSON_free()
+char* cJSON_PrintUnformatted(const cJSON* item);
+void cJSON_Delete(cJSON* item);
+void cJSON_free(void* object);
+
+#endif // HOST_CJSON_H
@@ -0,0 +1,11 @@
+#ifndef HOST_DISPLAY_H
+#define HOST_DISPLAY_H
+
+// Stand-in for main/display/display.h, the host has no screen
+class Display {
+public:
+    virtual ~Display() = default;
+    virtual void UpdateVolume(int volume) {}
+};
+
+#endif // HOST_DISPLAY_H
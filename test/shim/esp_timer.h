@@ -0,0 +1,39 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <cstdint>
+
+#include <esp_err.h>
+
+// Microseconds of the steady clock, or of the frozen host clock, see host_shim.h
+int64_t esp_timer_get_time();
+
+/*
+ * Every timer has a thread of its own, which calls the callback, whatever the dispatch method.
+ * Timeouts run on the steady clock, the frozen host clock does not hold them back.
+ */
+struct HostTimer;
+typedef HostTimer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+// ESP_ERR_INVALID_STATE if the timer is not running
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,36 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Like in ESP-IDF, the configuration comes in with FreeRTOS.h
+#include <sdkconfig.h>
+
+/*
+ * The part of the FreeRTOS API the audio pipeline uses, on top of std::thread.
+ * One tick is one millisecond.
+ */
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef uint8_t StackType_t;
+
+struct HostTask;
+struct HostEventGroup;
+typedef HostTask* TaskHandle_t;
+typedef HostEventGroup* EventGroupHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+
+#endif // HOST_FREERTOS_H
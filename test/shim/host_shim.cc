@@ -0,0 +1,613 @@
+#include "host_shim.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <opus.h>
+#include <opus_decoder.h>
+#include <opus_resampler.h>
+#include <driver/i2s_common.h>
+#include <settings.h>
+#include <cJSON.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+};
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+static thread_local HostTask* current_task = nullptr;
+
+static std::chrono::steady_clock::time_point Deadline(TickType_t ticks) {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+}
+
+/* Clock */
+
+static std::atomic<bool> clock_frozen = false;
+static std::atomic<int64_t> frozen_time_us = 0;
+
+void HostClockFreeze(int64_t time_us) {
+    frozen_time_us = time_us;
+    clock_frozen = true;
+}
+
+void HostClockAdvance(int64_t delta_us) {
+    frozen_time_us += delta_us;
+}
+
+void HostClockRelease() {
+    clock_frozen = false;
+}
+
+int64_t esp_timer_get_time() {
+    if (clock_frozen) {
+        return frozen_time_us;
+    }
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Timers */
+
+struct HostTimer {
+    esp_timer_cb_t callback;
+    void* arg;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool armed = false;
+    bool deleted = false;
+    int64_t period_us = 0;
+    std::chrono::steady_clock::time_point deadline;
+    std::thread thread;
+};
+
+static void HostTimerLoop(HostTimer* timer) {
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    while (!timer->deleted) {
+        if (!timer->armed) {
+            timer->cv.wait(lock);
+            continue;
+        }
+        if (timer->cv.wait_until(lock, timer->deadline) == std::cv_status::no_timeout) {
+            // Stopped, restarted or deleted meanwhile
+            continue;
+        }
+        if (timer->period_us > 0) {
+            timer->deadline += std::chrono::microseconds(timer->period_us);
+        } else {
+            timer->armed = false;
+        }
+        // The callback may start or stop the timer itself
+        lock.unlock();
+        timer->callback(timer->arg);
+        lock.lock();
+    }
+}
+
+static esp_err_t HostTimerStart(esp_timer_handle_t timer, uint64_t timeout_us, bool periodic) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->period_us = periodic ? timeout_us : 0;
+    timer->deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+    timer->cv.notify_one();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (create_args == nullptr || create_args->callback == nullptr || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto timer = new HostTimer();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->thread = std::thread(HostTimerLoop, timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return HostTimerStart(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return HostTimerStart(timer, period, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    timer->cv.notify_one();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        if (timer->armed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        timer->deleted = true;
+        timer->cv.notify_one();
+    }
+    if (timer->thread.get_id() == std::this_thread::get_id()) {
+        // Deleted from its own callback
+        timer->thread.detach();
+    } else {
+        timer->thread.join();
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+/* Tasks */
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle) {
+    // Tasks are never joined, their state lives as long as the process
+    auto task = new HostTask();
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    std::thread([task, function, arg]() {
+        current_task = task;
+        function(arg);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    return xTaskCreate(function, name, stack_depth, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != nullptr && task != xTaskGetCurrentTaskHandle()) {
+        fprintf(stderr, "vTaskDelete of another task is not supported on the host\n");
+        abort();
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    return esp_timer_get_time() / 1000;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (current_task == nullptr) {
+        // Threads not created by xTaskCreate, e.g. the test main thread
+        static thread_local HostTask task;
+        current_task = &task;
+    }
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    auto task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task]() { return task->notifications > 0; };
+    if (ticks_to_wait == portMAX_DELAY) {
+        task->cv.wait(lock, ready);
+    } else {
+        task->cv.wait_until(lock, Deadline(ticks_to_wait), ready);
+    }
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+/* Event groups */
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t old_bits = group->bits;
+    group->bits &= ~bits;
+    return old_bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [group, bits, wait_for_all]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    if (ticks_to_wait == portMAX_DELAY) {
+        group->cv.wait(lock, ready);
+    } else {
+        group->cv.wait_until(lock, Deadline(ticks_to_wait), ready);
+    }
+    EventBits_t result = group->bits;
+    if (ready() && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+/* Logging */
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    static const int max_level = []() {
+        const char* env = getenv("HOST_LOG_LEVEL");
+        return env != nullptr ? atoi(env) : int(ESP_LOG_WARN);
+    }();
+    if (level > max_level) {
+        return;
+    }
+    // One write per line, so the lines of several tasks don't interleave
+    static const char letters[] = "NEWIDV";
+    char line[512];
+    int length = snprintf(line, sizeof(line), "%c (%s) ", letters[level], tag);
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+    if (length > int(sizeof(line)) - 2) {
+        length = sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+    fwrite(line, 1, length, stderr);
+}
+
+/* Heap */
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+void* heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+    return calloc(count, size);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+/* I2S */
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    return handle != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+    return handle != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* Settings */
+
+static std::mutex settings_mutex;
+static std::map<std::string, std::string> settings_strings;
+static std::map<std::string, int32_t> settings_ints;
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    auto it = settings_strings.find(ns_ + "." + key);
+    return it != settings_strings.end() ? it->second : default_value;
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    if (read_write_) {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        settings_strings[ns_ + "." + key] = value;
+    }
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    auto it = settings_ints.find(ns_ + "." + key);
+    return it != settings_ints.end() ? it->second : default_value;
+}
+
+void Settings::SetInt(const std::string& key, int32_t value) {
+    if (read_write_) {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        settings_ints[ns_ + "." + key] = value;
+    }
+}
+
+void Settings::EraseKey(const std::string& key) {
+    if (read_write_) {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        settings_strings.erase(ns_ + "." + key);
+        settings_ints.erase(ns_ + "." + key);
+    }
+}
+
+void Settings::EraseAll() {
+    if (!read_write_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    std::string prefix = ns_ + ".";
+    std::erase_if(settings_strings, [&prefix](const auto& entry) { return entry.first.starts_with(prefix); });
+    std::erase_if(settings_ints, [&prefix](const auto& entry) { return entry.first.starts_with(prefix); });
+}
+
+/* cJSON */
+
+static cJSON* NewItem(int type) {
+    auto item = static_cast<cJSON*>(calloc(1, sizeof(cJSON)));
+    item->type = type;
+    return item;
+}
+
+cJSON* cJSON_CreateObject(void) {
+    return NewItem(cJSON_Object);
+}
+
+cJSON* cJSON_CreateArray(void) {
+    return NewItem(cJSON_Array);
+}
+
+cJSON* cJSON_CreateNumber(double number) {
+    auto item = NewItem(cJSON_Number);
+    item->valuedouble = number;
+    item->valueint = static_cast<int>(number);
+    return item;
+}
+
+cJSON* cJSON_CreateBool(cJSON_bool boolean) {
+    return NewItem(boolean ? cJSON_True : cJSON_False);
+}
+
+cJSON* cJSON_CreateString(const char* string) {
+    auto item = NewItem(cJSON_String);
+    item->valuestring = strdup(string);
+    return item;
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON* array, cJSON* item) {
+    if (array == nullptr || item == nullptr) {
+        return 0;
+    }
+    if (array->child == nullptr) {
+        array->child = item;
+        item->prev = item;
+    } else {
+        // Like cJSON, the first child's prev points to the last one
+        cJSON* last = array->child->prev;
+        last->next = item;
+        item->prev = last;
+        array->child->prev = item;
+    }
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON* object, const char* name, cJSON* item) {
+    if (item == nullptr || name == nullptr) {
+        return 0;
+    }
+    free(item->string);
+    item->string = strdup(name);
+    return cJSON_AddItemToArray(object, item);
+}
+
+cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) {
+    auto item = cJSON_CreateNumber(number);
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, cJSON_bool boolean) {
+    auto item = cJSON_CreateBool(boolean);
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string) {
+    auto item = cJSON_CreateString(string);
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+static void PrintString(const char* string, std::string& out) {
+    out += '"';
+    for (const char* p = string; *p != '\0'; p++) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+static void PrintItem(const cJSON* item, std::string& out) {
+    switch (item->type) {
+    case cJSON_False:
+        out += "false";
+        break;
+    case cJSON_True:
+        out += "true";
+        break;
+    case cJSON_NULL:
+        out += "null";
+        break;
+    case cJSON_Number: {
+        char number[32];
+        snprintf(number, sizeof(number), "%.15g", item->valuedouble);
+        out += number;
+        break;
+    }
+    case cJSON_String:
+        PrintString(item->valuestring, out);
+        break;
+    case cJSON_Array:
+    case cJSON_Object: {
+        bool object = item->type == cJSON_Object;
+        out += object ? '{' : '[';
+        for (const cJSON* child = item->child; child != nullptr; child = child->next) {
+            if (child != item->child) {
+                out += ',';
+            }
+            if (object) {
+                PrintString(child->string, out);
+                out += ':';
+            }
+            PrintItem(child, out);
+        }
+        out += object ? '}' : ']';
+        break;
+    }
+    }
+}
+
+char* cJSON_PrintUnformatted(const cJSON* item) {
+    if (item == nullptr) {
+        return nullptr;
+    }
+    std::string out;
+    PrintItem(item, out);
+    return strdup(out.c_str());
+}
+
+void cJSON_Delete(cJSON* item) {
+    while (item != nullptr) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+void cJSON_free(void* object) {
+    free(object);
+}
+
+/* OpusDecoderWrapper */
+
+OpusDecoderWrapper::OpusDecoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms) {
+    int error;
+    audio_dec_ = opus_decoder_create(sample_rate, channels, &error);
+    if (audio_dec_ == nullptr) {
+        ESP_LOGE("OpusDecoderWrapper", "Failed to create audio decoder, error code: %d", error);
+    }
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+}
+
+OpusDecoderWrapper::~OpusDecoderWrapper() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_dec_ != nullptr) {
+        opus_decoder_destroy(audio_dec_);
+    }
+}
+
+bool OpusDecoderWrapper::Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_dec_ == nullptr) {
+        return false;
+    }
+    pcm.resize(frame_size_);
+    auto ret = opus_decode(audio_dec_, opus.empty() ? nullptr : opus.data(), opus.size(), pcm.data(), pcm.size(), 0);
+    if (ret < 0) {
+        ESP_LOGE("OpusDecoderWrapper", "Failed to decode audio, error code: %d", ret);
+        return false;
+    }
+    pcm.resize(ret);
+    return true;
+}
+
+void OpusDecoderWrapper::ResetState() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_dec_ != nullptr) {
+        opus_decoder_ctl(audio_dec_, OPUS_RESET_STATE);
+    }
+}
+
+/* OpusResampler */
+
+void OpusResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+}
+
+int OpusResampler::GetOutputSamples(int input_samples) const {
+    return int64_t(input_samples) * output_sample_rate_ / input_sample_rate_;
+}
+
+void OpusResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    int count = GetOutputSamples(input_samples);
+    for (int i = 0; i < count; i++) {
+        int64_t position = int64_t(i) * input_sample_rate_ * 65536 / output_sample_rate_;
+        int index = position >> 16;
+        int fraction = position & 0xFFFF;
+        int next = index + 1 < input_samples ? index + 1 : index;
+        output[i] = input[index] + ((int32_t(input[next]) - input[index]) * fraction >> 16);
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <cstdint>
+
+/*
+ * Controls of the host shim, for tests that need a deterministic clock.
+ *
+ * While the clock is frozen, esp_timer_get_time() returns the frozen time, which only moves
+ * with HostClockAdvance(). Blocking calls (vTaskDelay, ulTaskNotifyTake) keep using real time.
+ */
+void HostClockFreeze(int64_t time_us);
+void HostClockAdvance(int64_t delta_us);
+void HostClockRelease();
+
+#endif // HOST_SHIM_H
@@ -0,0 +1,62 @@
+#ifndef HOST_MBEDTLS_AES_H
+#define HOST_MBEDTLS_AES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <openssl/evp.h>
+
+/*
+ * The mbedtls AES calls MqttProtocol makes, on the AES block cipher of OpenSSL. CTR follows
+ * mbedtls: the counter is incremented big endian over all 16 bytes, nc_off and stream_block carry
+ * a partial block between calls. Only the MQTT UDP crypto benchmark includes this, it links
+ * libcrypto. The device runs mbedtls on the AES peripheral, the host times are not its times.
+ */
+
+typedef struct {
+    EVP_CIPHER_CTX* cipher;
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    ctx->cipher = EVP_CIPHER_CTX_new();
+}
+
+inline void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    EVP_CIPHER_CTX_free(ctx->cipher);
+    ctx->cipher = nullptr;
+}
+
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    if (keybits != 128 || EVP_EncryptInit_ex(ctx->cipher, EVP_aes_128_ecb(), nullptr, key, nullptr) != 1) {
+        return -0x0020;
+    }
+    EVP_CIPHER_CTX_set_padding(ctx->cipher, 0);
+    return 0;
+}
+
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off,
+    unsigned char nonce_counter[16], unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    size_t n = *nc_off;
+    if (n > 0x0F) {
+        return -0x0021;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            int out_length;
+            if (EVP_EncryptUpdate(ctx->cipher, stream_block, &out_length, nonce_counter, 16) != 1) {
+                return -0x0021;
+            }
+            for (int j = 15; j >= 0; j--) {
+                if (++nonce_counter[j] != 0) {
+                    break;
+                }
+            }
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 0x0F;
+    }
+    *nc_off = n;
+    return 0;
+}
+
+#endif // HOST_MBEDTLS_AES_H
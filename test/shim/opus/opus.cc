@@ -0,0 +1,145 @@
+#include <opus.h>
+
+#include <cstddef>
+
+/* Stand-in codec, see opus.h */
+
+// Decimation factor and frame size in samples per channel, little endian
+static constexpr int kHeaderSize = 3;
+
+struct OpusEncoder {
+    int channels;
+};
+
+struct OpusDecoder {
+    int channels;
+    opus_int16 last_sample;     // Concealed frames fade out from here
+};
+
+static bool ValidConfig(opus_int32 sample_rate, int channels) {
+    switch (sample_rate) {
+    case 8000:
+    case 12000:
+    case 16000:
+    case 24000:
+    case 48000:
+        return channels == 1 || channels == 2;
+    default:
+        return false;
+    }
+}
+
+OpusEncoder* opus_encoder_create(opus_int32 sample_rate, int channels, int application, int* error) {
+    if (!ValidConfig(sample_rate, channels)) {
+        if (error != nullptr) {
+            *error = OPUS_BAD_ARG;
+        }
+        return nullptr;
+    }
+    if (error != nullptr) {
+        *error = OPUS_OK;
+    }
+    return new OpusEncoder{channels};
+}
+
+void opus_encoder_destroy(OpusEncoder* encoder) {
+    delete encoder;
+}
+
+int opus_encoder_ctl(OpusEncoder* encoder, int request, ...) {
+    // The size is set per packet by max_data_bytes, the other settings don't apply
+    return encoder != nullptr ? OPUS_OK : OPUS_BAD_ARG;
+}
+
+opus_int32 opus_encode(OpusEncoder* encoder, const opus_int16* pcm, int frame_size, unsigned char* data,
+    opus_int32 max_data_bytes) {
+    if (encoder == nullptr || frame_size <= 0 || frame_size > 0xFFFF) {
+        return OPUS_BAD_ARG;
+    }
+    if (max_data_bytes <= kHeaderSize) {
+        return OPUS_BUFFER_TOO_SMALL;
+    }
+    int samples = frame_size * encoder->channels;
+    int room = max_data_bytes - kHeaderSize;
+    int factor = (samples + room - 1) / room;
+    if (factor > 255) {
+        return OPUS_BUFFER_TOO_SMALL;
+    }
+    data[0] = factor;
+    data[1] = frame_size & 0xFF;
+    data[2] = frame_size >> 8;
+    int size = kHeaderSize;
+    for (int i = 0; i < samples; i += factor) {
+        data[size++] = static_cast<uint16_t>(pcm[i]) >> 8;
+    }
+    return size;
+}
+
+OpusDecoder* opus_decoder_create(opus_int32 sample_rate, int channels, int* error) {
+    if (!ValidConfig(sample_rate, channels)) {
+        if (error != nullptr) {
+            *error = OPUS_BAD_ARG;
+        }
+        return nullptr;
+    }
+    if (error != nullptr) {
+        *error = OPUS_OK;
+    }
+    return new OpusDecoder{channels, 0};
+}
+
+void opus_decoder_destroy(OpusDecoder* decoder) {
+    delete decoder;
+}
+
+int opus_decoder_ctl(OpusDecoder* decoder, int request, ...) {
+    if (decoder == nullptr) {
+        return OPUS_BAD_ARG;
+    }
+    if (request == OPUS_RESET_STATE) {
+        decoder->last_sample = 0;
+    }
+    return OPUS_OK;
+}
+
+int opus_decode(OpusDecoder* decoder, const unsigned char* data, opus_int32 len, opus_int16* pcm, int frame_size,
+    int decode_fec) {
+    if (decoder == nullptr || frame_size <= 0) {
+        return OPUS_BAD_ARG;
+    }
+    int samples = frame_size * decoder->channels;
+
+    if (data == nullptr || len == 0) {
+        for (int i = 0; i < samples; i++) {
+            pcm[i] = decoder->last_sample * (samples - i) / samples;
+        }
+        decoder->last_sample = 0;
+        return frame_size;
+    }
+
+    if (len <= kHeaderSize) {
+        return OPUS_INVALID_PACKET;
+    }
+    int factor = data[0];
+    int frame = data[1] | (data[2] << 8);
+    int count = len - kHeaderSize;
+    if (factor == 0 || frame == 0 || count != (frame * decoder->channels + factor - 1) / factor) {
+        return OPUS_INVALID_PACKET;
+    }
+    if (frame > frame_size) {
+        return OPUS_BUFFER_TOO_SMALL;
+    }
+
+    // Linear interpolation between the kept samples, the last one is held
+    const unsigned char* kept = data + kHeaderSize;
+    samples = frame * decoder->channels;
+    for (int i = 0; i < samples; i++) {
+        int index = i / factor;
+        int fraction = i % factor;
+        int current = static_cast<int8_t>(kept[index]) * 256;
+        int next = index + 1 < count ? static_cast<int8_t>(kept[index + 1]) * 256 : current;
+        pcm[i] = current + (next - current) * fraction / factor;
+    }
+    decoder->last_sample = pcm[samples - 1];
+    return frame;
+}
@@ -0,0 +1,30 @@
+#ifndef HOST_OPUS_DECODER_H
+#define HOST_OPUS_DECODER_H
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include <opus.h>
+
+// OpusDecoderWrapper of the esp-opus-encoder component, on the libopus decoder API (see opus/opus.h)
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusDecoderWrapper();
+
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm);
+    void ResetState();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    std::mutex mutex_;
+    OpusDecoder* audio_dec_ = nullptr;
+    int frame_size_;
+    int sample_rate_;
+    int duration_ms_;
+};
+
+#endif // HOST_OPUS_DECODER_H
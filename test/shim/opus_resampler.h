@@ -0,0 +1,25 @@
+#ifndef HOST_OPUS_RESAMPLER_H
+#define HOST_OPUS_RESAMPLER_H
+
+#include <cstdint>
+
+/*
+ * Stand-in for the OpusResampler of the esp-opus-encoder component, which wraps the SILK
+ * resampler of libopus. It interpolates linearly, so GenericResampler runs on the host,
+ * but its quality says nothing about the device.
+ */
+class OpusResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate);
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+    int GetOutputSamples(int input_samples) const;
+
+    inline int input_sample_rate() const { return input_sample_rate_; }
+    inline int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+};
+
+#endif // HOST_OPUS_RESAMPLER_H
@@ -0,0 +1,16 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+/*
+ * Configuration of the host build: the Kconfig defaults of a board without PSRAM, with
+ * NoAudioProcessor and without wake word, so no esp-sr model is needed.
+ */
+
+#define CONFIG_USE_ADAPTIVE_UPLINK_BITRATE 1
+#define CONFIG_PROMPT_CACHE_SIZE_KB 0
+#define CONFIG_AUDIO_REORDER_WINDOW_MS 60
+#define CONFIG_AUDIO_INPUT_POWER_OFF_DELAY_MS 15000
+#define CONFIG_AUDIO_OUTPUT_POWER_OFF_DELAY_MS 15000
+#define CONFIG_AUDIO_POWER_MIN_ON_MS 3000
+
+#endif // HOST_SDKCONFIG_H
@@ -0,0 +1,25 @@
+#ifndef HOST_SETTINGS_H
+#define HOST_SETTINGS_H
+
+#include <string>
+#include <cstdint>
+
+// Stand-in for main/settings.h without NVS, the values live until the process exits
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false);
+    ~Settings() = default;
+
+    std::string GetString(const std::string& key, const std::string& default_value = "");
+    void SetString(const std::string& key, const std::string& value);
+    int32_t GetInt(const std::string& key, int32_t default_value = 0);
+    void SetInt(const std::string& key, int32_t value);
+    void EraseKey(const std::string& key);
+    void EraseAll();
+
+private:
+    std::string ns_;
+    bool read_write_ = false;
+};
+
+#endif // HOST_SETTINGS_H
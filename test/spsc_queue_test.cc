@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "spsc_queue.h"
+
+TEST(SpscQueue, PushPopInOrder) {
+    SpscQueue<int> queue(4);
+    for (int i = 0; i < 4; i++) {
+        int value = i;
+        EXPECT_TRUE(queue.Push(std::move(value)));
+    }
+    int extra = 4;
+    EXPECT_FALSE(queue.Push(std::move(extra)));
+    EXPECT_TRUE(queue.Full());
+    for (int i = 0; i < 4; i++) {
+        int value = -1;
+        EXPECT_TRUE(queue.Pop(value));
+        EXPECT_EQ(value, i);
+    }
+    int value;
+    EXPECT_FALSE(queue.Pop(value));
+}
+
+TEST(SpscQueue, LimitBelowCapacity) {
+    SpscQueue<int> queue(8);
+    queue.SetLimit(2);
+    int a = 1, b = 2, c = 3;
+    EXPECT_TRUE(queue.Push(std::move(a)));
+    EXPECT_TRUE(queue.Push(std::move(b)));
+    EXPECT_FALSE(queue.Push(std::move(c)));
+    queue.SetLimit(100);
+    EXPECT_EQ(queue.limit(), 8u);
+}
+
+TEST(SpscQueue, ClearKeepsLaterItems) {
+    SpscQueue<std::unique_ptr<int>> queue(4);
+    queue.Push(std::make_unique<int>(1));
+    queue.Push(std::make_unique<int>(2));
+    queue.RequestClear();
+    queue.Push(std::make_unique<int>(3));
+    std::unique_ptr<int> item;
+    EXPECT_TRUE(queue.Pop(item));
+    EXPECT_EQ(*item, 3);
+    EXPECT_TRUE(queue.Empty());
+}
+
+TEST(SpscQueue, NotifiesTheConsumer) {
+    SpscQueue<int> queue(16);
+    queue.SetConsumerTask(xTaskGetCurrentTaskHandle());
+    const int count = 10000;
+    std::thread producer([&]() {
+        queue.SetProducerTask(xTaskGetCurrentTaskHandle());
+        for (int i = 0; i < count; i++) {
+            int value = i;
+            while (!queue.Push(std::move(value))) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            }
+        }
+    });
+    for (int i = 0; i < count; i++) {
+        int value = -1;
+        while (!queue.Pop(value)) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        }
+        ASSERT_EQ(value, i);
+    }
+    producer.join();
+}
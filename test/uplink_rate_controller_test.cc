@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "uplink_encoder.h"
+
+#define FRAME_MS 60
+
+// Feeds the frames of one window, the failures with the first frame. Returns what the last frame returned.
+static bool RunWindow(UplinkRateController& controller, int backlog_ms, uint32_t failures = 0, int encode_load = 10) {
+    int64_t encode_time_us = FRAME_MS * 10 * encode_load;
+    bool changed = false;
+    for (int ms = 0; ms < UPLINK_RATE_WINDOW_MS; ms += FRAME_MS) {
+        changed = controller.OnFrameEncoded(FRAME_MS, encode_time_us, backlog_ms, ms == 0 ? failures : 0);
+        if (ms + FRAME_MS < UPLINK_RATE_WINDOW_MS) {
+            EXPECT_FALSE(changed) << "the window ended early at " << ms << " ms";
+        }
+    }
+    return changed;
+}
+
+TEST(UplinkRateController, WindowIsCountedInAudioTime) {
+    UplinkRateController controller;
+    int frames = (UPLINK_RATE_WINDOW_MS + FRAME_MS - 1) / FRAME_MS;
+    for (int i = 0; i < frames - 1; i++) {
+        EXPECT_FALSE(controller.OnFrameEncoded(FRAME_MS, 0, 2 * UPLINK_BACKLOG_HIGH_MS, 0));
+    }
+    EXPECT_EQ(controller.GetStatistics().step_downs, 0u);
+    EXPECT_TRUE(controller.OnFrameEncoded(FRAME_MS, 0, 2 * UPLINK_BACKLOG_HIGH_MS, 0));
+    EXPECT_EQ(controller.GetStatistics().step_downs, 1u);
+}
+
+TEST(UplinkRateController, BacklogStepsDown) {
+    UplinkRateController controller;
+    int bitrate = controller.settings().bitrate;
+
+    // A backlog between the marks keeps the settings
+    EXPECT_FALSE(RunWindow(controller, UPLINK_BACKLOG_HIGH_MS - FRAME_MS));
+    EXPECT_EQ(controller.settings().bitrate, bitrate);
+
+    EXPECT_TRUE(RunWindow(controller, UPLINK_BACKLOG_HIGH_MS));
+    auto one_step = controller.GetStatistics();
+    EXPECT_LT(one_step.settings.bitrate, bitrate);
+    EXPECT_EQ(one_step.level, 3);
+    EXPECT_EQ(one_step.backlog_ms, UPLINK_BACKLOG_HIGH_MS);
+
+    // Twice the high mark takes two steps, down to the bottom of the ladder
+    EXPECT_TRUE(RunWindow(controller, 2 * UPLINK_BACKLOG_HIGH_MS));
+    auto bottom = controller.GetStatistics();
+    EXPECT_EQ(bottom.level, 5);
+    EXPECT_LT(bottom.settings.bitrate, one_step.settings.bitrate);
+    EXPECT_TRUE(bottom.settings.dtx);
+    EXPECT_EQ(bottom.step_downs, 2u);
+
+    // Nothing below the bottom
+    EXPECT_FALSE(RunWindow(controller, 4 * UPLINK_BACKLOG_HIGH_MS));
+    EXPECT_EQ(controller.GetStatistics().level, 5);
+    EXPECT_EQ(controller.GetStatistics().step_downs, 2u);
+}
+
+TEST(UplinkRateController, SendFailureStepsDown) {
+    UplinkRateController controller;
+    int bitrate = controller.settings().bitrate;
+    EXPECT_TRUE(RunWindow(controller, 0, 3));
+    EXPECT_LT(controller.settings().bitrate, bitrate);
+    auto stats = controller.GetStatistics();
+    EXPECT_EQ(stats.send_failures, 3u);
+    EXPECT_EQ(stats.step_downs, 1u);
+}
+
+TEST(UplinkRateController, ClearWindowsProbeUp) {
+    UplinkRateController controller;
+    int bitrate = controller.settings().bitrate;
+    for (int i = 0; i < UPLINK_RATE_PROBE_WINDOWS - 1; i++) {
+        RunWindow(controller, UPLINK_BACKLOG_LOW_MS);
+        EXPECT_EQ(controller.settings().bitrate, bitrate);
+    }
+    EXPECT_TRUE(RunWindow(controller, UPLINK_BACKLOG_LOW_MS));
+    EXPECT_GT(controller.settings().bitrate, bitrate);
+    EXPECT_EQ(controller.GetStatistics().step_ups, 1u);
+
+    // A backlog in between starts the count again
+    bitrate = controller.settings().bitrate;
+    for (int i = 0; i < UPLINK_RATE_PROBE_WINDOWS - 1; i++) {
+        RunWindow(controller, 0);
+    }
+    RunWindow(controller, UPLINK_BACKLOG_LOW_MS + FRAME_MS);
+    for (int i = 0; i < UPLINK_RATE_PROBE_WINDOWS - 1; i++) {
+        RunWindow(controller, 0);
+    }
+    EXPECT_EQ(controller.settings().bitrate, bitrate);
+    RunWindow(controller, 0);
+    EXPECT_GT(controller.settings().bitrate, bitrate);
+}
+
+TEST(UplinkRateController, EncodeLoadCapsTheComplexity) {
+    UplinkRateController controller;
+    // Probe up to the top of the ladder on an idle CPU, the complexity cap follows
+    for (int i = 0; i < 10 * UPLINK_RATE_PROBE_WINDOWS; i++) {
+        RunWindow(controller, 0);
+    }
+    auto top = controller.GetStatistics();
+    EXPECT_EQ(top.level, 0);
+    int complexity = top.settings.complexity;
+    ASSERT_GT(complexity, 0);
+
+    // Each window over the high mark takes one step of complexity, the bitrate stays
+    EXPECT_TRUE(RunWindow(controller, 0, 0, UPLINK_ENCODE_LOAD_HIGH));
+    EXPECT_EQ(controller.settings().complexity, complexity - 1);
+    EXPECT_EQ(controller.settings().bitrate, top.settings.bitrate);
+    EXPECT_EQ(controller.GetStatistics().encode_load, UPLINK_ENCODE_LOAD_HIGH);
+    EXPECT_EQ(controller.GetStatistics().complexity_limits, 1u);
+
+    // A load in between keeps it, enough light windows raise it again
+    EXPECT_FALSE(RunWindow(controller, 0, 0, (UPLINK_ENCODE_LOAD_HIGH + UPLINK_ENCODE_LOAD_LOW) / 2));
+    for (int i = 0; i < UPLINK_RATE_PROBE_WINDOWS - 1; i++) {
+        EXPECT_FALSE(RunWindow(controller, 0, 0, UPLINK_ENCODE_LOAD_LOW));
+    }
+    EXPECT_TRUE(RunWindow(controller, 0, 0, UPLINK_ENCODE_LOAD_LOW));
+    EXPECT_EQ(controller.settings().complexity, complexity);
+}
+
+TEST(UplinkRateController, ChannelOpenBacklogIsNotALink) {
+    /* What the controller would do if fed the frames queued while the audio channel opens:
+       AudioService holds it until the send queue has been flushed, see HoldUplinkRateControl() */
+    UplinkRateController fed;
+    UplinkRateController held;
+    int queued_ms = 0;
+    for (int ms = 0; ms < 2 * UPLINK_RATE_WINDOW_MS; ms += FRAME_MS) {
+        queued_ms += FRAME_MS;
+        fed.OnFrameEncoded(FRAME_MS, 0, queued_ms, 0);
+    }
+    EXPECT_GT(fed.GetStatistics().level, held.GetStatistics().level);
+
+    // Once the channel is open the sender keeps up, and the held controller starts from its default
+    EXPECT_FALSE(RunWindow(held, FRAME_MS));
+    EXPECT_EQ(held.GetStatistics().step_downs, 0u);
+}